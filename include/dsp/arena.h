@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstddef>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace dsp {
+
+/**
+ * @brief Arena for small, long lived allocations of a pipeline (coroutine frames).
+ *
+ * Memory is carved out of large blocks and released with the arena. Freed
+ * allocations are kept in a free list per size: the frames of a filter all have the
+ * same size, so the frame of a coroutine restarted after a reset reuses the
+ * previous one.
+ */
+class FrameArena
+{
+public:
+    explicit FrameArena(std::size_t block_size = 64 * 1024);
+
+    FrameArena(const FrameArena&) = delete;
+    FrameArena& operator=(const FrameArena&) = delete;
+
+    void * allocate(std::size_t n);
+    void   deallocate(void * p, std::size_t n);
+
+    std::size_t n_blocks() const;
+
+private:
+    static constexpr std::size_t alignment = alignof(std::max_align_t);
+
+    mutable std::mutex mutex_;
+    std::size_t        block_size_;
+    std::size_t        offset_;    /**< first free byte of the current block */
+    std::vector<std::unique_ptr<std::byte[]>>  blocks_;
+    std::map<std::size_t, std::vector<void*>>  free_;
+
+    static std::size_t aligned(std::size_t n) {return (n + alignment - 1) & ~(alignment - 1);}
+};
+
+} /* namespace dsp */
@@ -1,7 +1,7 @@
 #pragma once
 
+#include <algorithm>
 #include <memory>
-#include <deque>
 
 #include "filter.h"
 #include "link.h"
@@ -9,13 +9,15 @@
 namespace dsp::filter {
 
 /**
- * @brief Concatenate input chunks into larger output chunks.
+ * @brief Re-chunk the input stream into output chunks of a different size.
  *
- * Shared pointers to the input chunks are stored inside an internal queue until
- * enough are present. The data is then copied to the output chunk and the queue
- * is cleared. The remaining data is stored inside an internal chunk for the next
- * output.
- * NB: fmt_in.n_rows must be < fmt_out.n_rows (format negotiation will fail otherwise)
+ * Incoming rows are copied once, directly into the output chunk being filled (taken
+ * from the output link pool). An input chunk can complete several output chunks
+ * and an output chunk can span several input chunks, so any in/out row ratio is
+ * supported. When the sizes are equal and aligned the input chunk is forwarded as is.
+ *
+ * An output chunk never spans a gap: the partially filled chunk is dropped when a
+ * discontinuous input arrives.
  *
  * @tparam T Type of data processed by the filter.
  */
@@ -38,85 +40,96 @@ public:
 
         auto input    = dynamic_cast<Link<T>*>(inputs_.at("in"));
         auto output   = dynamic_cast<Link<T>*>(outputs_.at("out"));
-        auto chunk_in = std::make_shared<Chunk<T>>();
+        typename Link<T>::const_elem_type chunk_in;
 
         if (!input->pop(chunk_in)) {
             if (input->eof())
                 output->eof_reached();
             return 0;
         }
-        chunk_queue_.push_back(chunk_in);
 
         const auto fmt_in  = input->format();
         const auto fmt_out = output->format();
 
-        i_++;
-        if (n_intern_ + fmt_in.n_rows * i_ < fmt_out.n_rows)
-            return 0;
-
-        i_ = 0;
-        arma::uword timestamp = chunk_queue_.front()->timestamp;
-        arma::uword t_intern  = n_intern_ * chunk_in->sample_period;
-        if (t_intern > timestamp) {
-            log_error(logger_, "invalid timestamp");
-        } else {
-            timestamp -= t_intern;
+        if (chunk_out_ && chunk_in->header.has(chunk_flag::discontinuity)) {
+            log_debug(logger_, "{}: discontinuity, {} rows dropped", name_, n_fill_);
+            input->count_dropped();
+            chunk_out_ = nullptr;
+            n_fill_ = 0;
         }
-        auto chunk_out = std::make_shared<Chunk<T>>(timestamp, chunk_in->sample_period, fmt_out);
 
-        // first copy the internal chunk
-        if (n_intern_ != 0) {
-            chunk_out->rows(0, n_intern_ - 1) = chunk_intern_.rows(0, n_intern_ - 1);
+        if (n_fill_ == 0 && fmt_in.n_rows == fmt_out.n_rows) {
+            output->push(chunk_in);
+            return 1;
         }
-        arma::uword beg = n_intern_;
-        arma::uword end = beg;
-        n_intern_ = 0;
-        for (auto it = chunk_queue_.cbegin(); it < chunk_queue_.cend(); ++it) {
-            end += (*it)->n_rows;
-            if (end > fmt_out.n_rows) {
-                n_intern_ = end - fmt_out.n_rows;
-                end = fmt_in.n_rows - n_intern_;
-                chunk_out->rows(beg, fmt_out.n_rows - 1) = (*it)->rows(0, end - 1);
-                chunk_intern_.rows(0, n_intern_ - 1) = (*it)->rows(end, fmt_in.n_rows - 1);
-            } else {
-                chunk_out->rows(beg, end - 1) = **it;
-                beg = end;
+
+        int ret = 0;
+        arma::uword row = 0;
+        while (row < fmt_in.n_rows) {
+            if (!chunk_out_) {
+                auto header = chunk_in->header;
+                header.timestamp = chunk_in->header.time(row);
+                chunk_out_ = output->make_chunk(header);
+                n_fill_ = 0;
+            }
+            chunk_out_->header.merge(chunk_in->header);
+
+            arma::uword n = std::min(fmt_in.n_rows - row, fmt_out.n_rows - n_fill_);
+            chunk_out_->rows(n_fill_, n_fill_ + n - 1) = chunk_in->rows(row, row + n - 1);
+            row     += n;
+            n_fill_ += n;
+
+            if (n_fill_ == fmt_out.n_rows) {
+                output->push(chunk_out_);
+                chunk_out_ = nullptr;
+                n_fill_ = 0;
+                ret = 1;
             }
         }
-        chunk_queue_.clear();
 
-        output->push(chunk_out);
-        return 1;
+        return ret;
     }
 
     void reset() override
     {
-        i_ = 0;
-        n_intern_ = 0;
-        chunk_queue_.clear();
+        n_fill_ = 0;
+        chunk_out_ = nullptr;
+    }
+
+    void propagate_format() override
+    {
+        // the output size is free, only the channels are derived
+        auto fmt = input_pads_["in"].format;
+        derive_output_format({0, fmt.n_cols, fmt.n_slices}, "out");
     }
 
     Contract negotiate_format() override
     {
+        if (!time_major_pads())
+            return Contract::unsupported_format;
+
         auto fmt_in  = input_pads_["in"].format;
         auto fmt_out = output_pads_["out"].format;
 
         if (fmt_in.n_cols   != fmt_out.n_cols ||
             fmt_in.n_slices != fmt_out.n_slices ||
-            fmt_in.n_rows   >= fmt_out.n_rows) {
+            fmt_in.n_rows   == 0 || fmt_out.n_rows == 0) {
             return Contract::unsupported_format;
         }
 
-        chunk_intern_.set_size(fmt_in.n_rows, fmt_in.n_cols, fmt_in.n_slices);
+        reset();
 
         return Contract::supported_format;
     }
 
+    std::size_t memory_usage() const override
+    {
+        return chunk_out_ ? chunk_out_->n_elem * sizeof(T) : 0;
+    }
+
 private:
-    arma::uword i_ = 0;
-    arma::uword n_intern_ = 0;
-    Chunk<T>    chunk_intern_;
-    std::deque<std::shared_ptr<Chunk<T>>> chunk_queue_;
+    arma::uword n_fill_ = 0;  /**< number of rows already copied in chunk_out_ */
+    std::shared_ptr<Chunk<T>> chunk_out_;
 };
 
 } /* namespace dsp::filter */
@@ -0,0 +1,103 @@
+#pragma once
+
+#include <cstdint>
+#include <numeric>
+
+namespace dsp {
+
+/**
+ * @brief Sample period as a rational number of ns.
+ *
+ * Periods that aren't a whole number of ns (e.g. 4 kHz = 250000 ns but 3 kHz =
+ * 1e6/3 ns) and the periods derived by resampling are exact, only the timestamps
+ * computed from them are rounded.
+ */
+struct Period
+{
+    int64_t num; /**< ns */
+    int64_t den;
+
+    static Period ns(int64_t n) {return {n, 1};}
+    static Period us(int64_t n) {return {n * 1000, 1};}
+    static Period ms(int64_t n) {return {n * 1000000, 1};}
+    static Period hz(int64_t f) {return Period{1000000000, f}.reduced();}
+
+    Period reduced() const
+    {
+        const int64_t g = std::gcd(num, den);
+        return g ? Period{num / g, den / g} : *this;
+    }
+
+    /**
+     * @brief Period multiplied by mul / div (e.g. decimation or resampling).
+     */
+    Period scaled(int64_t mul, int64_t div = 1) const
+    {
+        return Period{num * mul, den * div}.reduced();
+    }
+
+    /**
+     * @brief Duration of n periods in ns (rounded toward 0).
+     */
+    int64_t duration(int64_t n) const {return n * num / den;}
+
+    double to_ms() const {return static_cast<double>(num) / den / 1e6;}
+
+    bool operator==(const Period& p) const {return num * p.den == p.num * den;}
+    bool operator!=(const Period& p) const {return !(*this == p);}
+};
+
+namespace chunk_flag {
+enum : uint32_t {
+    discontinuity = 1u << 0, /**< the chunk doesn't follow the previous one (gap, reset) */
+    invalid       = 1u << 1, /**< some of the data is invalid (e.g. zero-filled frames) */
+};
+} /* namespace chunk_flag */
+
+/**
+ * @brief Metadata of a chunk.
+ *
+ * Stored next to the payload (not in its allocation): the pools recycle the payloads
+ * and overwrite the header at each acquire.
+ */
+struct ChunkHeader
+{
+    int64_t  timestamp     = 0;             /**< time of the first row in ns */
+    Period   sample_period = Period::ms(1); /**< time between two rows */
+    uint64_t seq           = 0;             /**< index of the chunk on the link that produced it */
+    uint32_t flags         = 0;             /**< chunk_flag */
+
+    /**
+     * @name Tracing
+     *
+     * Stamped by the sources & carried through the filters: a chunk aggregating
+     * several inputs keeps the trace id of the first one & the range of their
+     * ingress times (see merge). The ingress times are trace::now() values, 0 if
+     * unknown.
+     * @{ */
+    uint64_t trace_id      = 0;
+    int64_t  ingress_first = 0;             /**< arrival of the oldest contributing frame */
+    int64_t  ingress_last  = 0;             /**< arrival of the newest contributing frame */
+    /**  @} */
+
+    /**
+     * @brief Time of a row in ns.
+     */
+    int64_t time(int64_t row) const {return timestamp + sample_period.duration(row);}
+
+    bool has(uint32_t flag) const {return (flags & flag) != 0;}
+
+    /**
+     * @brief Merge the flags & ingress range of a contributing chunk.
+     */
+    void merge(const ChunkHeader& h)
+    {
+        flags |= h.flags;
+        if (h.ingress_first && (!ingress_first || h.ingress_first < ingress_first))
+            ingress_first = h.ingress_first;
+        if (h.ingress_last > ingress_last)
+            ingress_last = h.ingress_last;
+    }
+};
+
+} /* namespace dsp */
@@ -8,10 +8,20 @@
 #include "common/log.h"
 #include "filter.h"
 #include "link.h"
+#include "forest.h"
 
 namespace dsp::filter {
 
-/* TODO: use template for model <24-03-21, cneyton> */
+/**
+ * @brief Random forest classification of feature vectors.
+ *
+ * Each column of the input chunk is a feature vector. The mlpack model is compiled
+ * into a FlatForest when it's loaded and the class probabilities are written
+ * directly in the output chunk: either all of them (fmt_out.n_rows == n_classes)
+ * or only the probability of the last class (fmt_out.n_rows == 1).
+ *
+ * @tparam T Data type
+ */
 template<typename T = double>
 class Classifier: public Filter
 {
@@ -31,7 +41,7 @@ public:
 
         auto input    = dynamic_cast<Link<T>*>(inputs_.at("in"));
         auto output   = dynamic_cast<Link<T>*>(outputs_.at("out"));
-        auto chunk_in = std::make_shared<Chunk<T>>();
+        typename Link<T>::const_elem_type chunk_in;
 
         if (!input->pop(chunk_in)) {
             if (input->eof())
@@ -39,16 +49,17 @@ public:
             return 0;
         }
 
+        const auto fmt_in  = input->format();
         const auto fmt_out = output->format();
-        auto chunk_out = std::make_shared<Chunk<T>>(chunk_in->timestamp, chunk_in->sample_period,
-                                                    fmt_out);
+        auto chunk_out = output->make_chunk(chunk_in->header);
 
-        arma::Row<size_t> predictions;
-        for (arma::uword k = 0; k < fmt_out.n_slices; ++k) {
-            rf_.Classify(chunk_in->slice(k), predictions, chunk_out->slice(k));
-        }
+        // slices are contiguous: all the feature vectors are classified in one batch
+        const arma::uword cls_beg = forest_.n_classes() - fmt_out.n_rows;
+        forest_.predict(chunk_in->memptr(), fmt_in.n_rows, fmt_in.n_cols * fmt_in.n_slices,
+                        chunk_out->memptr(), cls_beg, fmt_out.n_rows);
 
         output->push(chunk_out);
+        return 1;
     }
 
     void reset() override
@@ -56,27 +67,56 @@ public:
         // nothing to do
     }
 
+    void propagate_format() override
+    {
+        auto fmt = input_pads_["in"].format;
+        derive_output_format({forest_.n_classes(), fmt.n_cols, fmt.n_slices}, "out");
+    }
+
     Contract negotiate_format() override
     {
+        if (!time_major_pads())
+            return Contract::unsupported_format;
+
         auto fmt_in  = input_pads_["in"].format;
         auto fmt_out = output_pads_["out"].format;
 
+        if (forest_.empty()) {
+            log_error(logger_, "{}: no model loaded", name_);
+            return Contract::unsupported_format;
+        }
+
         if (fmt_in.n_cols   != fmt_out.n_cols ||
             fmt_in.n_slices != fmt_out.n_slices ||
-            fmt_out.n_rows  != 1 ) {
+            fmt_in.n_rows   <  forest_.n_features() ||
+            (fmt_out.n_rows != 1 && fmt_out.n_rows != forest_.n_classes())) {
             return Contract::unsupported_format;
         }
 
         return Contract::supported_format;
     }
 
+    /**
+     * @brief Load & compile an mlpack model saved in xml.
+     */
     void load_model(const std::filesystem::path& filename, const std::string& model_name)
     {
-        mlpack::data::Load(filename, model_name, rf_, true, mlpack::data::format::xml);
+        mlpack::tree::RandomForest<mlpack::tree::GiniGain> rf;
+        mlpack::data::Load(filename, model_name, rf, true, mlpack::data::format::xml);
+        forest_ = FlatForest::compile(rf);
+    }
+
+    /**
+     * @brief Map a binary model (see FlatForest::save), shared with the other
+     * classifiers of the process using the same file.
+     */
+    void load_model(const std::filesystem::path& filename)
+    {
+        forest_ = FlatForest::load(filename);
     }
 
 private:
-    mlpack::tree::RandomForest<mlpack::tree::GiniGain> rf_;
+    FlatForest forest_;
 };
 
 } /* namespace dsp::filter */
@@ -0,0 +1,237 @@
+#pragma once
+
+#ifndef DSP_COROUTINES
+#error "the coroutine filter API requires the DSP_COROUTINES option (C++20)"
+#endif
+
+#include <coroutine>
+#include <cstddef>
+#include <exception>
+#include <memory>
+#include <string>
+#include <utility>
+
+#include "arena.h"
+#include "filter.h"
+#include "link.h"
+#include "pipeline.h"
+
+namespace dsp {
+
+/**
+ * @brief Coroutine running the body of a CoroFilter.
+ *
+ * The frame is allocated from the arena set with Task::Arena around the call
+ * starting the coroutine (or from the heap if none).
+ */
+class Task
+{
+public:
+    struct promise_type;
+    using handle = std::coroutine_handle<promise_type>;
+
+    /**
+     * @brief Arena of the frames of the coroutines started in its scope.
+     */
+    class Arena
+    {
+    public:
+        explicit Arena(FrameArena * arena): prev_(std::exchange(current_, arena)) {}
+        ~Arena() {current_ = prev_;}
+
+        Arena(const Arena&) = delete;
+        Arena& operator=(const Arena&) = delete;
+
+        static FrameArena * current() {return current_;}
+
+    private:
+        FrameArena * prev_;
+        inline static thread_local FrameArena * current_ = nullptr;
+    };
+
+    struct promise_type
+    {
+        LinkInterface *    waiting = nullptr; /**< link awaited by the suspended body */
+        std::exception_ptr exception;
+
+        Task get_return_object() {return Task(handle::from_promise(*this));}
+        std::suspend_always initial_suspend() noexcept {return {};}
+        std::suspend_always final_suspend()   noexcept {return {};}
+        void return_void() {}
+        void unhandled_exception() {exception = std::current_exception();}
+
+        // the arena is stored in front of the frame (one alignment unit)
+        static void * operator new(std::size_t n)
+        {
+            FrameArena * arena = Arena::current();
+            auto p = static_cast<std::byte*>(arena ? arena->allocate(n + header)
+                                                   : ::operator new(n + header));
+            *reinterpret_cast<FrameArena**>(p) = arena;
+            return p + header;
+        }
+
+        static void operator delete(void * ptr, std::size_t n)
+        {
+            auto p = static_cast<std::byte*>(ptr) - header;
+            auto arena = *reinterpret_cast<FrameArena**>(p);
+            if (arena)
+                arena->deallocate(p, n + header);
+            else
+                ::operator delete(p);
+        }
+
+    private:
+        static constexpr std::size_t header = alignof(std::max_align_t);
+    };
+
+    Task() = default;
+    Task(Task&& t) noexcept: h_(std::exchange(t.h_, {})) {}
+    Task& operator=(Task&& t) noexcept
+    {
+        if (this != &t) {
+            destroy();
+            h_ = std::exchange(t.h_, {});
+        }
+        return *this;
+    }
+    ~Task() {destroy();}
+
+    explicit operator bool() const {return static_cast<bool>(h_);}
+    bool done() const {return h_.done();}
+
+    /**
+     * @brief true if the link awaited by the body has a chunk (or has ended).
+     */
+    bool resumable() const
+    {
+        auto w = h_.promise().waiting;
+        return !w || !w->empty() || w->eof();
+    }
+
+    /**
+     * @brief Run the body until its next suspension, rethrow its exceptions.
+     */
+    void resume()
+    {
+        h_.promise().waiting = nullptr;
+        h_.resume();
+        if (auto e = std::exchange(h_.promise().exception, nullptr))
+            std::rethrow_exception(e);
+    }
+
+private:
+    handle h_;
+
+    explicit Task(handle h): h_(h) {}
+
+    void destroy()
+    {
+        if (h_)
+            h_.destroy();
+        h_ = {};
+    }
+};
+
+/**
+ * @brief Awaitable returned by CoroFilter::pop.
+ *
+ * Resumes with the next chunk of the link, or with a null chunk once the link has
+ * ended.
+ */
+template<typename T>
+class PopAwaiter
+{
+public:
+    explicit PopAwaiter(Link<T> * link): link_(link) {}
+
+    bool await_ready() const {return !link_->empty() || link_->eof();}
+
+    void await_suspend(Task::handle h)
+    {
+        h.promise().waiting = link_;
+        // the source is asked once per suspension, the body isn't resumed before
+        // the link delivers
+        link_->request();
+    }
+
+    typename Link<T>::const_elem_type await_resume()
+    {
+        typename Link<T>::const_elem_type chunk;
+        link_->pop(chunk);
+        return chunk;
+    }
+
+private:
+    Link<T> * link_;
+};
+
+/**
+ * @brief Base class of the filters written as a coroutine.
+ *
+ * Instead of a state machine re-entered at each activation, the filter implements
+ * `run` as a loop awaiting its inputs:
+ *
+ *     Task run() override
+ *     {
+ *         for (;;) {
+ *             auto chunk = co_await pop<T>("in");
+ *             if (!chunk)
+ *                 break;
+ *             ...
+ *             output->push(chunk_out);
+ *         }
+ *         output->eof_reached();
+ *     }
+ *
+ * NB: keep co_await out of loop conditions, GCC 12 miscompiles them.
+ *
+ * The scheduler resumes the body where it was suspended. While the awaited link is
+ * empty the activations return immediately without running the body, and the
+ * source of the link is only woken up once per suspension instead of at every
+ * activation. A reset destroys the coroutine: the body restarts from the
+ * beginning at the next activation (the filters overriding reset must call
+ * CoroFilter::reset).
+ *
+ * Only available with the DSP_COROUTINES option (C++20).
+ */
+class CoroFilter: public Filter
+{
+public:
+    using Filter::Filter;
+
+    int activate() override
+    {
+        log_debug(logger_, "{} filter activated", name_);
+
+        if (!task_) {
+            Task::Arena arena(pipeline_ ? &pipeline_->frame_arena() : nullptr);
+            task_ = run();
+        }
+        if (task_.done() || !task_.resumable())
+            return 0;
+        task_.resume();
+        return 1;
+    }
+
+    void reset() override
+    {
+        task_ = Task();
+    }
+
+protected:
+    /**
+     * @brief Body of the filter, started at the first activation.
+     */
+    virtual Task run() = 0;
+
+    template<typename T>
+    PopAwaiter<T> pop(const std::string& pad_name)
+    {
+        return PopAwaiter<T>(dynamic_cast<Link<T>*>(inputs_.at(pad_name)));
+    }
+
+private:
+    Task task_;
+};
+
+} /* namespace dsp */
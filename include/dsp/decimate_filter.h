@@ -0,0 +1,194 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+
+#include "sigpack.h"
+#include "filter.h"
+#include "link.h"
+#include "fir.h"
+
+namespace dsp::filter {
+
+/**
+ * @brief Anti-alias filtering & integer factor decimation.
+ *
+ * Only the output samples that are kept are computed (polyphase form). The filter
+ * can either run a single FIR stage or a CIC stage followed by a FIR stage, the
+ * total decimation factor being the product of both factors.
+ *
+ * The default FIR is a sp::fir1 low-pass with 8*M+1 taps and a cutoff of 1/M (same
+ * design as sp::resampling).
+ *
+ * NB: fmt_in.n_rows must be equal to fmt_out.n_rows * factor (format negotiation
+ * will fail otherwise)
+ *
+ * @tparam T1 Data type
+ * @tparam T2 Taps type
+ */
+template<typename T1, typename T2 = double>
+class Decimate: public Filter
+{
+public:
+    /**
+     * @brief Single stage decimation.
+     *
+     * @param factor Decimation factor
+     * @param taps FIR taps (default sp::fir1 design if empty)
+     */
+    Decimate(common::Logger logger, std::string_view name, arma::uword factor,
+             const arma::Col<T2>& taps = arma::Col<T2>()):
+        Filter(logger, name)
+    {
+        add_pads();
+        stages_.emplace_back(taps.is_empty() ? default_taps(factor) : taps, factor);
+    }
+
+    Decimate(common::Logger logger, arma::uword factor,
+             const arma::Col<T2>& taps = arma::Col<T2>()):
+        Decimate(logger, "decimate", factor, taps)
+    {
+    }
+
+    /**
+     * @brief Two stages decimation: CIC then FIR.
+     *
+     * @param cic_order Order of the CIC stage
+     * @param cic_factor Decimation factor of the CIC stage
+     * @param fir_factor Decimation factor of the FIR stage
+     * @param taps FIR taps (default sp::fir1 design if empty)
+     */
+    Decimate(common::Logger logger, std::string_view name,
+             arma::uword cic_order, arma::uword cic_factor, arma::uword fir_factor,
+             const arma::Col<T2>& taps = arma::Col<T2>()):
+        Filter(logger, name)
+    {
+        add_pads();
+        stages_.emplace_back(arma::conv_to<arma::Col<T2>>::from(fir::cic(cic_order, cic_factor)),
+                             cic_factor);
+        stages_.emplace_back(taps.is_empty() ? default_taps(fir_factor) : taps, fir_factor);
+    }
+
+    int activate() override
+    {
+        log_debug(logger_, "{} filter activated", name_);
+
+        auto input    = dynamic_cast<Link<T1>*>(inputs_.at("in"));
+        auto output   = dynamic_cast<Link<T1>*>(outputs_.at("out"));
+        typename Link<T1>::const_elem_type chunk_in;
+
+        if (!input->pop(chunk_in)) {
+            if (input->eof())
+                output->eof_reached();
+            return 0;
+        }
+
+        // batched path: the chunks already queued are decimated together, channel by
+        // channel, so that the delay lines of a channel stay in cache
+        std::vector<typename Link<T1>::const_elem_type> chunks_in {std::move(chunk_in)};
+        if (batch_size() != 1)
+            input->pop_queued(chunks_in, batch_size() ? batch_size() - 1 : 0);
+
+        const auto fmt_in = input->format();
+
+        std::vector<typename Link<T1>::elem_type> chunks_out;
+        for (auto& c: chunks_in) {
+            // timestamp of the first kept sample
+            auto header = c->header;
+            header.timestamp     = c->header.time(factor() - 1);
+            header.sample_period = header.sample_period.scaled(factor());
+            chunks_out.push_back(output->make_chunk(header));
+        }
+
+        arma::uword n = 0;
+        for (arma::uword k = 0; k < fmt_in.n_slices; ++k) {
+            for (arma::uword j = 0; j < fmt_in.n_cols; ++j) {
+                for (std::size_t c = 0; c < chunks_in.size(); ++c) {
+                    const T1 * in_ptr = chunks_in[c]->slice_colptr(k, j);
+                    T1 * out_ptr      = chunks_out[c]->slice_colptr(k, j);
+                    if (stages_.size() == 1) {
+                        stages_[0].process(n, in_ptr, out_ptr);
+                    } else {
+                        // the cic stage writes directly in the work buffer of the fir stage
+                        stages_[0].process(n, in_ptr, stages_[1].input_ptr(n));
+                        stages_[1].process(n, out_ptr);
+                    }
+                }
+                n++;
+            }
+        }
+
+        for (std::size_t c = 0; c < chunks_in.size(); ++c) {
+            if (verbose_) {
+                chunks_in[c]->print();
+                chunks_out[c]->print();
+            }
+            output->push(chunks_out[c]);
+        }
+        return 1;
+    }
+
+    void reset() override
+    {
+        std::for_each(stages_.begin(), stages_.end(), [](auto& s){s.clear();});
+    }
+
+    void propagate_format() override
+    {
+        auto fmt = input_pads_["in"].format;
+        derive_output_format({fmt.n_rows / factor(), fmt.n_cols, fmt.n_slices}, "out");
+    }
+
+    Contract negotiate_format() override
+    {
+        if (!time_major_pads())
+            return Contract::unsupported_format;
+
+        auto fmt_in  = input_pads_["in"].format;
+        auto fmt_out = output_pads_["out"].format;
+
+        if (fmt_in.n_cols   != fmt_out.n_cols ||
+            fmt_in.n_slices != fmt_out.n_slices ||
+            fmt_in.n_rows   != fmt_out.n_rows * factor()) {
+            return Contract::unsupported_format;
+        }
+
+        // Allocate the work buffers
+        arma::uword n_rows = fmt_in.n_rows;
+        for (auto& s: stages_) {
+            s.resize(n_rows, fmt_in.n_cols * fmt_in.n_slices);
+            n_rows = s.n_out();
+        }
+
+        return Contract::supported_format;
+    }
+
+    arma::uword factor() const
+    {
+        arma::uword f = 1;
+        for (auto& s: stages_)
+            f *= s.factor();
+        return f;
+    }
+
+private:
+    std::vector<FirDecimator<T1, T2>> stages_;
+
+    void add_pads()
+    {
+        Pad in  {.name = "in" , .format = Format()};
+        Pad out {.name = "out", .format = Format()};
+        input_pads_.insert({in.name, in});
+        output_pads_.insert({out.name, out});
+    }
+
+    static
+    arma::Col<T2> default_taps(arma::uword factor)
+    {
+        if (factor == 0)
+            throw dsp_error(Errc::invalid_parameters);
+        return arma::conv_to<arma::Col<T2>>::from(sp::fir1(8 * factor, 1.0 / factor));
+    }
+};
+
+} /* namespace dsp::filter */
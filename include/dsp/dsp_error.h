@@ -1,6 +1,7 @@
 #pragma once
 
 #include <stdexcept>
+#include <string>
 #include <system_error>
 
 namespace dsp {
@@ -13,6 +14,9 @@ enum class Errc {
     format_negotiation_failed,
     invalid_parameters,
     duplicate_filter,
+    invalid_model,
+    misaligned_chunks,
+    invalid_graph,
 };
 
 struct ErrorCategory: public std::error_category
@@ -27,9 +31,13 @@ class dsp_error: public std::runtime_error
 {
 public:
     dsp_error(Errc e): dsp_error(make_error_code(e)) {};
+    /** error with some context appended to the message */
+    dsp_error(Errc e, const std::string& what): dsp_error(make_error_code(e), what) {};
     const std::error_code& code() const noexcept {return errc_;};
 private:
     dsp_error(const std::error_code& e): std::runtime_error(e.message()), errc_(e) {}
+    dsp_error(const std::error_code& e, const std::string& what):
+        std::runtime_error(e.message() + ": " + what), errc_(e) {}
     std::error_code errc_;
 };
 
@@ -1,6 +1,9 @@
 #pragma once
 
+#include <memory>
+
 #include "sigpack.h"
+#include "fftw.h"
 #include "filter.h"
 #include "link.h"
 
@@ -18,8 +21,7 @@ class FD: public Filter
 {
 public:
     FD(common::Logger logger, std::string_view name, arma::uword nfft, arma::vec window):
-        Filter(logger, name), nfft_(nfft),
-        fftw_(sp::FFTW(nfft, FFTW_MEASURE)), window_(window)
+        Filter(logger, name), nfft_(nfft), window_(window)
     {
         Pad in  {.name = "in" , .format = Format()};
         Pad out {.name = "out", .format = Format()};
@@ -38,7 +40,7 @@ public:
 
         auto input    = dynamic_cast<Link<T1>*>(inputs_.at("in"));
         auto output   = dynamic_cast<Link<T2>*>(outputs_.at("out"));
-        auto chunk_in = std::make_shared<Chunk<T1>>();
+        typename Link<T1>::const_elem_type chunk_in;
 
         if (!input->pop(chunk_in)) {
             if (input->eof())
@@ -48,9 +50,9 @@ public:
 
         const auto fmt_in  = input->format();
         const auto fmt_out = output->format();
-        auto chunk_out = std::make_shared<Chunk<T2>>(chunk_in->timestamp,
-                                                     chunk_in->sample_period * fmt_in.n_rows,
-                                                     fmt_out);
+        auto header = chunk_in->header;
+        header.sample_period = header.sample_period.scaled(fmt_in.n_rows);
+        auto chunk_out = output->make_chunk(header);
 
         /* TODO: add zero padding and windowing  <26-03-20, cneyton> */
         arma::Col<T2> w   = arma::regspace<arma::Col<T2>>(0, nfft_-1) - static_cast<T2>(nfft_)/2;
@@ -59,7 +61,7 @@ public:
         for (arma::uword k = 0; k < fmt_in.n_slices; k++) {
             for (arma::uword j = 0; j < fmt_in.n_cols; j++) {
                 in_ = chunk_in->slice(k).col(j);
-                fftw_.fft_cx(in_, in_);
+                fftw_->fft_cx(in_, in_);
                 in_ = arma::shift(in_, shift);
                 arma::Col<T2> psd = arma::square(arma::abs(in_));
                 T2 m0 = arma::sum(psd);
@@ -82,27 +84,54 @@ public:
     {
     }
 
+    void propagate_format() override
+    {
+        auto fmt = input_pads_["in"].format;
+        derive_output_format({1, fmt.n_cols, fmt.n_slices}, "out");
+    }
+
     Contract negotiate_format() override
     {
+        if (!time_major_pads())
+            return Contract::unsupported_format;
+
         auto fmt_in  = input_pads_["in"].format;
         auto fmt_out = output_pads_["out"].format;
 
         if (fmt_in.n_cols   != fmt_out.n_cols ||
             fmt_in.n_slices != fmt_out.n_slices ||
+            fmt_in.n_rows   != nfft_ ||
             fmt_out.n_rows  != 1) {
             return Contract::unsupported_format;
         }
 
-        // Create fftw plan by first application of fft
-        in_ = arma::Col<T1>(nfft_);
-        fftw_.fft_cx(in_, in_);
+        // Create fftw plan by first application of fft (kept if nfft is unchanged)
+        if (!fftw_ || fftw_->size() != nfft_) {
+            fftw_ = std::make_unique<fftw::FFT>(nfft_, FFTW_MEASURE);
+            in_ = arma::Col<T1>(nfft_);
+            fftw_->fft_cx(in_, in_);
+        }
 
         return Contract::supported_format;
     }
 
+    /**
+     * @brief Change the fft size (applied at the next negotiation, see
+     * Pipeline::reconfigure). The input chunks must have nfft rows.
+     */
+    void set_nfft(arma::uword nfft, const arma::vec& window)
+    {
+        if (nfft == 0 || window.n_elem != nfft)
+            throw dsp_error(Errc::invalid_parameters);
+        nfft_   = nfft;
+        window_ = window;
+    }
+
+    arma::uword nfft() const {return nfft_;}
+
 private:
     arma::uword   nfft_;
-    sp::FFTW      fftw_;
+    std::unique_ptr<fftw::FFT> fftw_;
     arma::vec     window_;
     arma::Col<T1> in_;
 };
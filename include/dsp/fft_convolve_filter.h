@@ -0,0 +1,231 @@
+#pragma once
+
+#include <algorithm>
+#include <memory>
+
+#include "sigpack.h"
+#include "fftw.h"
+#include "filter.h"
+#include "link.h"
+#include "fir.h"
+
+namespace dsp::filter {
+
+/**
+ * @brief FIR filtering of long kernels by uniformly partitioned overlap-save.
+ *
+ * The taps are split in P partitions of B taps whose spectra (FFT size 2B) are
+ * computed once. Each block of B input samples is transformed once and stored in a
+ * frequency-domain delay line, the output block being the IFFT of the sum of the
+ * last P input spectra multiplied by the partition spectra. The delay line and
+ * the last input block of each channel are carried between chunks.
+ *
+ * Kernels shorter than `fft_threshold` taps are filtered in the time domain
+ * (FirDecimator with a factor of 1) since the FFT path doesn't pay off for them.
+ *
+ * NB: fmt_in must be equal to fmt_out and fmt_in.n_rows must be a multiple of the
+ * block size (format negotiation will fail otherwise)
+ *
+ * @tparam T1 Data type
+ * @tparam T2 Taps type
+ */
+template<typename T1, typename T2 = double>
+class FFTConvolve: public Filter
+{
+public:
+    /**
+     * @param taps FIR taps
+     * @param block_size Partition size B (0 to use the chunk size)
+     * @param fft_threshold Minimum number of taps to use the FFT path
+     */
+    FFTConvolve(common::Logger logger, std::string_view name, const arma::Col<T2>& taps,
+                arma::uword block_size = 0, arma::uword fft_threshold = 64):
+        Filter(logger, name),
+        taps_(taps), block_size_(block_size), fft_threshold_(fft_threshold)
+    {
+        Pad in  {.name = "in" , .format = Format()};
+        Pad out {.name = "out", .format = Format()};
+        input_pads_.insert({in.name, in});
+        output_pads_.insert({out.name, out});
+
+        if (taps_.is_empty())
+            throw dsp_error(Errc::invalid_parameters);
+    }
+
+    FFTConvolve(common::Logger logger, const arma::Col<T2>& taps,
+                arma::uword block_size = 0, arma::uword fft_threshold = 64):
+        FFTConvolve(logger, "fft_convolve", taps, block_size, fft_threshold)
+    {
+    }
+
+    int activate() override
+    {
+        log_debug(logger_, "{} filter activated", name_);
+
+        auto input    = dynamic_cast<Link<T1>*>(inputs_.at("in"));
+        auto output   = dynamic_cast<Link<T1>*>(outputs_.at("out"));
+        typename Link<T1>::const_elem_type chunk_in;
+
+        if (!input->pop(chunk_in)) {
+            if (input->eof())
+                output->eof_reached();
+            return 0;
+        }
+
+        if (verbose_)
+            chunk_in->print();
+
+        // filter in place, both paths consume the input before writing the output
+        const auto fmt = output->format();
+        auto chunk = input->make_writable(std::move(chunk_in));
+        arma::uword n = 0;
+        for (arma::uword k = 0; k < fmt.n_slices; ++k) {
+            for (arma::uword j = 0; j < fmt.n_cols; ++j) {
+                T1 * ptr = chunk->slice_colptr(k, j);
+                if (use_fft()) {
+                    for (arma::uword b = 0; b < fmt.n_rows; b += block_size_)
+                        process_block(n, ptr + b, ptr + b);
+                } else {
+                    direct_.process(n, ptr, ptr);
+                }
+                n++;
+            }
+        }
+
+        if (verbose_)
+            chunk->print();
+
+        output->push(chunk);
+        return 1;
+    }
+
+    void reset() override
+    {
+        direct_.clear();
+        blocks_.zeros();
+        fdl_.zeros();
+        fdl_pos_.zeros();
+    }
+
+    void propagate_format() override
+    {
+        derive_output_format(input_pads_["in"].format, "out");
+    }
+
+    Contract negotiate_format() override
+    {
+        if (!time_major_pads())
+            return Contract::unsupported_format;
+
+        auto fmt_in  = input_pads_["in"].format;
+        auto fmt_out = output_pads_["out"].format;
+
+        if (fmt_in != fmt_out)
+            return Contract::unsupported_format;
+
+        const arma::uword n_channels = fmt_in.n_cols * fmt_in.n_slices;
+
+        if (!use_fft()) {
+            direct_ = FirDecimator<T1, T2>(taps_, 1);
+            direct_.resize(fmt_in.n_rows, n_channels);
+            return Contract::supported_format;
+        }
+
+        if (block_size_ == 0)
+            block_size_ = fmt_in.n_rows;
+        if (fmt_in.n_rows % block_size_ != 0)
+            return Contract::unsupported_format;
+
+        const arma::uword nfft = 2 * block_size_;
+        n_parts_ = (taps_.n_elem + block_size_ - 1) / block_size_;
+
+        // Create fftw plans by first application of fft on scratch arrays, since
+        // FFTW_MEASURE overwrites them (the plans are executed on the columns of the
+        // delay line, hence unaligned)
+        fftw_ = std::make_unique<fftw::FFT>(nfft, FFTW_MEASURE | FFTW_UNALIGNED);
+        {
+            arma::cx_vec x(nfft, arma::fill::zeros), f(nfft, arma::fill::zeros);
+            fftw_->fft_cx(x, f);
+            fftw_->ifft_cx(f, x);
+        }
+
+        // then compute the partition spectra
+        spectrum_.set_size(nfft);
+        time_.set_size(nfft);
+        parts_.set_size(nfft, n_parts_);
+        for (arma::uword p = 0; p < n_parts_; ++p) {
+            arma::uword beg = p * block_size_;
+            arma::uword end = std::min(beg + block_size_, taps_.n_elem) - 1;
+            time_.zeros();
+            for (arma::uword i = beg; i <= end; ++i)
+                time_(i - beg) = arma::cx_double(taps_(i));
+            fftw_->fft_cx(time_, spectrum_);
+            parts_.col(p) = spectrum_;
+        }
+
+        blocks_.zeros(nfft, n_channels);
+        fdl_.zeros(nfft, n_parts_, n_channels);
+        fdl_pos_.zeros(n_channels);
+
+        return Contract::supported_format;
+    }
+
+private:
+    arma::Col<T2> taps_;
+    arma::uword   block_size_;
+    arma::uword   fft_threshold_;
+
+    // time domain path
+    FirDecimator<T1, T2> direct_;
+
+    // frequency domain path
+    std::unique_ptr<fftw::FFT> fftw_;
+    arma::uword  n_parts_ = 0;
+    arma::uvec   fdl_pos_;      /**< slot of the newest spectrum in each delay line */
+    arma::cx_mat parts_;        /**< partition spectra, one per column */
+    arma::cx_mat blocks_;       /**< last two input blocks, one column per channel */
+    arma::cx_cube fdl_;         /**< frequency-domain delay line, one slice per channel */
+    arma::cx_vec spectrum_;
+    arma::cx_vec time_;
+
+    bool use_fft() const {return taps_.n_elem >= fft_threshold_;}
+
+    void process_block(arma::uword n, const T1 * in, T1 * out)
+    {
+        const arma::uword nfft = 2 * block_size_;
+
+        // slide the input window by one block
+        arma::cx_double * x = blocks_.colptr(n);
+        arma::arrayops::copy(x, x + block_size_, block_size_);
+        for (arma::uword i = 0; i < block_size_; ++i)
+            x[block_size_ + i] = arma::cx_double(in[i]);
+
+        // advance the delay line & transform the new window in place of the oldest spectrum
+        arma::uword slot = (fdl_pos_[n] + 1) % n_parts_;
+        fdl_pos_[n] = slot;
+        arma::cx_double * newest = fdl_.slice(n).colptr(slot);
+        arma::cx_vec xx(x, nfft, false, true);
+        arma::cx_vec ff(newest, nfft, false, true);
+        fftw_->fft_cx(xx, ff);
+
+        spectrum_.zeros();
+        for (arma::uword p = 0; p < n_parts_; ++p) {
+            const arma::cx_double * h = parts_.colptr(p);
+            const arma::cx_double * f = fdl_.slice(n).colptr((slot + n_parts_ - p) % n_parts_);
+            arma::cx_double * s = spectrum_.memptr();
+            for (arma::uword i = 0; i < nfft; ++i)
+                s[i] += h[i] * f[i];
+        }
+        fftw_->ifft_cx(spectrum_, time_);
+
+        // only the last block of the circular convolution is valid
+        for (arma::uword i = 0; i < block_size_; ++i) {
+            if constexpr (arma::is_cx<T1>::value)
+                out[i] = T1(time_(block_size_ + i));
+            else
+                out[i] = T1(time_(block_size_ + i).real());
+        }
+    }
+};
+
+} /* namespace dsp::filter */
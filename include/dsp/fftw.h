@@ -0,0 +1,77 @@
+#pragma once
+
+#include <filesystem>
+#include <mutex>
+
+#include <armadillo>
+#include <fftw3.h>
+
+namespace dsp::fftw {
+
+/**
+ * @brief Lock serializing the FFTW planner.
+ *
+ * Executing a plan is thread-safe but creating or destroying one isn't: pipelines
+ * running in different threads take this lock while negotiating formats (where the
+ * filters create their plans) and while being destroyed. It's recursive since the
+ * plans (see FFT) lock it too.
+ */
+std::recursive_mutex& planner_mutex();
+
+/**
+ * @brief Import the wisdom saved by `export_wisdom`.
+ *
+ * Plans already computed in another run (or by another pipeline of the process) are
+ * then created without measuring again.
+ *
+ * @return false if the file doesn't exist or can't be read
+ */
+bool import_wisdom(const std::filesystem::path& filename);
+
+/**
+ * @brief Save the wisdom accumulated by the process.
+ */
+bool export_wisdom(const std::filesystem::path& filename);
+
+/**
+ * @brief Number of plans created by the process (see FFT).
+ */
+unsigned long n_plans();
+
+/**
+ * @brief Complex FFT of a given length, used by the filters instead of sp::FFTW.
+ *
+ * Same interface as sp::FFTW: the plans are created at the first transform, on the
+ * given arrays (which FFTW_MEASURE overwrites) & reused on other arrays of the same
+ * alignment. Creating & destroying the plans is done under planner_mutex. Unlike
+ * sp::FFTW, the destructor doesn't call fftw_cleanup, which would invalidate the
+ * plans still used by the other filters & forget the imported wisdom.
+ */
+class FFT
+{
+public:
+    explicit FFT(arma::uword n, unsigned flags = FFTW_ESTIMATE): n_(n), flags_(flags) {}
+    ~FFT();
+
+    FFT(const FFT&) = delete;
+    FFT& operator=(const FFT&) = delete;
+
+    void fft_cx(arma::cx_vec& x, arma::cx_vec& spectrum);
+
+    /**
+     * @brief Inverse transform, normalized by the length.
+     */
+    void ifft_cx(arma::cx_vec& spectrum, arma::cx_vec& x);
+
+    arma::uword size() const {return n_;}
+
+private:
+    arma::uword n_;
+    unsigned    flags_;
+    fftw_plan   fft_  = nullptr;
+    fftw_plan   ifft_ = nullptr;
+
+    fftw_plan plan(arma::cx_vec& in, arma::cx_vec& out, int sign);
+};
+
+} /* namespace dsp::fftw */
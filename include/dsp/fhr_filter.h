@@ -8,6 +8,13 @@
 
 namespace dsp::filter {
 
+/**
+ * @brief Estimate the heart rate of each channel from the autocorrelation of its
+ * window.
+ *
+ * The windows flagged as invalid (zero-filled frames, or spanning a gap) are
+ * skipped: their outputs are 0 and keep the invalid flag.
+ */
 template<typename T1 = double, typename T2 = double, typename T3 = T2>
 class FHR: public Filter
 {
@@ -37,7 +44,7 @@ public:
         auto input      = dynamic_cast<Link<T1>*>(inputs_.at("in"));
         auto output_fhr = dynamic_cast<Link<T2>*>(outputs_.at("fhr"));
         auto output_cor = dynamic_cast<Link<T3>*>(outputs_.at("cor"));
-        auto chunk_in   = std::make_shared<Chunk<T1>>();
+        typename Link<T1>::const_elem_type chunk_in;
 
         if (!input->pop(chunk_in)) {
             if (input->eof()) {
@@ -50,14 +57,26 @@ public:
         const auto fmt_in  = input->format();
         const auto fmt_out = output_fhr->format();
 
-        arma::uword sample_period = chunk_in->sample_period * fmt_out.n_rows;
-        auto chunk_fhr = std::make_shared<Chunk<T2>>(chunk_in->timestamp, sample_period, fmt_out);
-        auto chunk_cor = std::make_shared<Chunk<T3>>(chunk_in->timestamp, sample_period, fmt_out);
+        auto header = chunk_in->header;
+        header.sample_period = header.sample_period.scaled(fmt_out.n_rows);
+        auto chunk_fhr = output_fhr->make_chunk(header);
+        auto chunk_cor = output_cor->make_chunk(header);
+
+        if (chunk_in->header.has(chunk_flag::invalid)) {
+            log_debug(logger_, "{}: invalid window {} skipped", name_, chunk_in->header.seq);
+            chunk_fhr->zeros();
+            chunk_cor->zeros();
+            n_skipped_++;
+            output_fhr->push(chunk_fhr);
+            output_cor->push(chunk_cor);
+            return 1;
+        }
 
         for (uint k = 0; k < fmt_in.n_slices; k++) {
             for (uint j = 0; j < fmt_in.n_cols; j++) {
-                auto col_ptr  = chunk_in->slice_colptr(k, j);
-                arma::Col<T1> x(col_ptr, fmt_in.n_rows, false, true);
+                // read-only view of the input column
+                auto col_ptr  = const_cast<T1*>(chunk_in->slice_colptr(k, j));
+                const arma::Col<T1> x(col_ptr, fmt_in.n_rows, false, true);
 
                 auto xcorr = correlate::xcorr(x, correlate::scale::unbiased);
                 xcorr = xcorr.subvec(x.n_elem - 1, xcorr.n_elem -1);
@@ -105,11 +124,26 @@ public:
 
     void reset() override
     {
-        // nothing to do
+        n_skipped_ = 0;
+    }
+
+    /**
+     * @brief Number of invalid windows skipped since the last reset.
+     */
+    arma::uword n_skipped() const {return n_skipped_;}
+
+    void propagate_format() override
+    {
+        auto fmt = input_pads_["in"].format;
+        derive_output_format({1, fmt.n_cols, fmt.n_slices}, "fhr");
+        derive_output_format({1, fmt.n_cols, fmt.n_slices}, "cor");
     }
 
     Contract negotiate_format() override
     {
+        if (!time_major_pads())
+            return Contract::unsupported_format;
+
         auto fmt_in  = input_pads_["in"].format;
         auto fmt_fhr = output_pads_["fhr"].format;
         auto fmt_cor = output_pads_["cor"].format;
@@ -128,6 +162,7 @@ private:
     arma::uword  radius_;
     arma::uword  period_max_;
     T3           threshold_;
+    arma::uword  n_skipped_ = 0;
 };
 
 } /* namespace dsp::filter */
@@ -1,15 +1,18 @@
 #pragma once
 
+#include <atomic>
 #include <chrono>
 #include <string>
 #include <vector>
 #include <map>
+#include <mutex>
 
 #include <armadillo>
 
 #include "common/log.h"
 
 #include "format.h"
+#include "perf.h"
 
 namespace dsp {
 
@@ -20,6 +23,7 @@ struct Pad
 {
     std::string    name;
     Format         format;
+    Format         requested; /**< format set explicitly, fields left to 0 are derived */
 };
 
 class Filter: public common::Log
@@ -66,44 +70,161 @@ public:
      */
     virtual Contract negotiate_format() = 0;
 
+    /**
+     * @brief Derive the output formats from the input formats.
+     *
+     * Called by Pipeline::negotiate_format once the input formats are known, before
+     * negotiate_format. Only the fields of the output formats that weren't set
+     * explicitly (i.e. left to 0) are derived, see derive_output_format. Filters
+     * whose outputs don't depend on their inputs (sources) keep the default.
+     */
+    virtual void propagate_format() {}
+
+    /**
+     * @brief Number of input chunks kept by the filter between activations.
+     *
+     * Used to size the pool of the input link so that nothing is allocated once the
+     * pipeline runs.
+     */
+    virtual arma::uword retained_chunks(const std::string& /*pad_name*/) const {return 0;}
+
+    /**
+     * @brief Bytes held by the filter between activations (queued chunks, partial
+     * outputs, recorded data...).
+     *
+     * The chunks kept from an input are counted by the filter, not by the link.
+     */
+    virtual std::size_t memory_usage() const {return 0;}
+
+    /**
+     * @brief Update the memory accounting of the filter (called by the pipeline
+     * after each activation).
+     */
+    void account_memory()
+    {
+        memory_ = memory_usage();
+        if (memory_ > peak_memory_)
+            peak_memory_ = memory_.load();
+    }
+
+    /** Bytes held at the last activation */
+    std::size_t memory()      const {return memory_;}
+    /** High-water mark of memory() since the last reset_stats */
+    std::size_t peak_memory() const {return peak_memory_;}
+
     void set_input_format(const Format& f, const std::string& pad_name);
     void set_output_format(const Format& f, const std::string& pad_name);
+
+    /**
+     * @brief Set the fields of an input format that weren't set explicitly to the
+     * ones of f (called by the links during the negotiation).
+     */
+    void derive_input_format(const Format& f, const std::string& pad_name);
     const Format& get_input_format(const std::string& pad_name);
     const Format& get_output_format(const std::string& pad_name);
 
+    const std::map<std::string, Pad>& input_pads()  const {return input_pads_;}
+    const std::map<std::string, Pad>& output_pads() const {return output_pads_;}
+
+    /**
+     * @brief Restore the pads saved from input_pads & output_pads (see
+     * Pipeline::reconfigure).
+     */
+    void restore_pads(const std::map<std::string, Pad>& inputs,
+                      const std::map<std::string, Pad>& outputs)
+    {
+        input_pads_  = inputs;
+        output_pads_ = outputs;
+    }
+
+    /**
+     * @name Scheduling flags
+     *
+     * A filter is ready when it has something to process (a chunk or the end of
+     * the stream was pushed on one of its inputs) and wanted when a downstream
+     * filter requested more data from it (see Pipeline::set_scheduling).
+     * @{ */
     bool is_ready() const noexcept {return ready_;}
     void set_ready()      noexcept {ready_ = true;}
     void reset_ready()    noexcept {ready_ = false;}
 
+    bool is_wanted() const noexcept {return wanted_;}
+    void set_wanted()      noexcept {wanted_ = true;}
+    void reset_wanted()    noexcept {wanted_ = false;}
+    /**  @} */
+
     std::string name() const {return name_;}
 
     Pipeline * pipeline() const {return pipeline_;}
     void       set_pipeline(Pipeline * p) {pipeline_ = p;}
 
+    /**
+     * @brief Maximum number of chunks processed per activation by the filters with a
+     * batched path (0 for no limit), set by Pipeline::set_batch_size.
+     */
+    void        set_batch_size(arma::uword n) {batch_size_ = n;}
+    arma::uword batch_size() const {return batch_size_;}
+
     // debug methods -----------------------------------------------------------
     void set_verbose()    {verbose_ = true;}
 
-    void update_stats(std::chrono::duration<double>& duration);
+    /**
+     * @name Profiling
+     *
+     * When profiling is on, the pipeline measures the time & hardware counters of
+     * each activation of the filter (see perf::ThreadCounters). It can be switched
+     * while the pipeline runs, the cost when off is the test of a flag.
+     * @{ */
+    void set_profiling(bool enable) {profiling_ = enable;}
+    bool profiling() const {return profiling_.load(std::memory_order_relaxed);}
+
+    /**
+     * @param c Counters of n activations
+     */
+    void update_stats(const perf::Counters& c, arma::uword n);
     void reset_stats();
-    arma::uword n_execs() const {return stats_.n_execs;}
+    arma::uword    n_execs() const;
+    perf::Counters perf_counters() const;
+    /**  @} */
+
+    /**
+     * @brief Count an activation (always enabled, unlike the profiling stats).
+     *
+     * @param idle true if the activation returned 0 (nothing done)
+     */
+    void count_activation(bool idle) {n_activations_++; n_idle_ += idle;}
+    arma::uword n_activations()      const {return n_activations_;}
+    arma::uword n_idle_activations() const {return n_idle_;}
 
     std::chrono::duration<double> total_exec_time() const
     {
-        return std::accumulate(stats_.durations.cbegin(), stats_.durations.cend(),
-                            std::chrono::duration<double>::zero());
+        return std::chrono::nanoseconds(perf_counters().time_ns);
     }
 
     std::chrono::duration<double> mean_exec_time() const
     {
-        if (stats_.n_execs == 0) return std::chrono::duration<double>::zero();
-        else return total_exec_time()/stats_.n_execs;
+        const auto n = n_execs();
+        if (n == 0) return std::chrono::duration<double>::zero();
+        else return total_exec_time()/n;
     }
     // -------------------------------------------------------------------------
 
 protected:
     std::string name_;
 
-    Pipeline * pipeline_;
+    /**
+     * @brief Set the fields of an output format that weren't set explicitly to the
+     * ones of f.
+     */
+    void derive_output_format(const Format& f, const std::string& pad_name);
+
+    /**
+     * @brief true if all the pads are time_major, the only layout the processing
+     * filters support (a channel_major source is transposed by its output link).
+     */
+    bool time_major_pads() const;
+
+    Pipeline * pipeline_ = nullptr;
     // maps pad names to filter links
     std::map<std::string, LinkInterface*>  inputs_;
     std::map<std::string, LinkInterface*>  outputs_;
@@ -111,14 +232,25 @@ protected:
     std::map<std::string, Pad>  input_pads_;
     std::map<std::string, Pad>  output_pads_;
 
-    bool ready_   = false;
+    std::atomic<bool> ready_  {false}; /**< may be set from another execution domain */
+    std::atomic<bool> wanted_ {false};
     bool verbose_ = false;
+    arma::uword batch_size_ = 1;
 
 private:
+    std::atomic<std::size_t> memory_ {0};
+    std::atomic<std::size_t> peak_memory_ {0};
+
+    arma::uword n_activations_ = 0;
+    arma::uword n_idle_        = 0;
+
+    std::atomic<bool> profiling_ {false};
+
+    mutable std::mutex stats_mutex_; /**< the stats may be read from another domain */
     struct
     {
-        arma::uword n_execs = 0;
-        std::vector<std::chrono::duration<double>> durations;
+        arma::uword    n_execs = 0;
+        perf::Counters counters;
     } stats_;
 };
 
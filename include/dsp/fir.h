@@ -0,0 +1,129 @@
+#pragma once
+
+#include <algorithm>
+
+#include <armadillo>
+
+#include "dsp_error.h"
+
+namespace dsp {
+
+/**
+ * @brief Stateful FIR kernel that only computes the samples it keeps.
+ *
+ * Each kept output is a single dot product between the (reversed) taps and a
+ * contiguous window of the work buffer, which is the polyphase decomposition
+ * flattened: samples dropped by the decimation are never computed.
+ *
+ * The work buffer of each channel holds the last K-1 input samples followed by
+ * the samples of the current block so that the history is carried from one block
+ * to the next without any allocation once `resize` has been called.
+ *
+ * @tparam T1 Data type
+ * @tparam T2 Taps type
+ */
+template<typename T1, typename T2 = double>
+class FirDecimator
+{
+public:
+    FirDecimator() = default;
+
+    FirDecimator(const arma::Col<T2>& taps, arma::uword factor):
+        taps_(arma::reverse(taps)), factor_(factor)
+    {
+        if (taps.is_empty() || factor == 0)
+            throw dsp_error(Errc::invalid_parameters);
+    }
+
+    /**
+     * @brief Allocate the work buffers & clear the history.
+     *
+     * @param n_in Number of input samples per block (must be a multiple of the factor)
+     * @param n_channels Number of independent channels
+     */
+    void resize(arma::uword n_in, arma::uword n_channels)
+    {
+        if (n_in % factor_ != 0)
+            throw dsp_error(Errc::invalid_parameters);
+        n_in_ = n_in;
+        work_.zeros(history() + n_in, n_channels);
+    }
+
+    void clear() {work_.zeros();}
+
+    arma::uword factor()  const {return factor_;}
+    arma::uword n_taps()  const {return taps_.n_elem;}
+    arma::uword history() const {return taps_.n_elem - 1;}
+    arma::uword n_in()    const {return n_in_;}
+    arma::uword n_out()   const {return n_in_ / factor_;}
+
+    /**
+     * @brief Pointer where the next block of channel j must be written.
+     *
+     * Used to chain stages without intermediate copies.
+     */
+    T1 * input_ptr(arma::uword j) {return work_.colptr(j) + history();}
+
+    /**
+     * @brief Filter & decimate the block already written at `input_ptr(j)`.
+     *
+     * Output sample m is aligned on input sample (m+1)*factor - 1 of the block.
+     */
+    void process(arma::uword j, T1 * out)
+    {
+        const arma::uword k_taps = taps_.n_elem;
+        const T2 * h = taps_.memptr();
+        T1 * w = work_.colptr(j);
+
+        for (arma::uword m = 0; m < n_out(); ++m) {
+            const T1 * x = w + (m + 1) * factor_ - 1;
+            T1 acc = T1(0);
+            for (arma::uword k = 0; k < k_taps; ++k)
+                acc += h[k] * x[k];
+            out[m] = acc;
+        }
+
+        // keep the last samples as history for the next block (ranges may overlap)
+        std::copy(w + n_in_, w + n_in_ + history(), w);
+    }
+
+    /**
+     * @brief Copy a block of channel j into the work buffer and process it.
+     */
+    void process(arma::uword j, const T1 * in, T1 * out)
+    {
+        arma::arrayops::copy(input_ptr(j), in, n_in_);
+        process(j, out);
+    }
+
+private:
+    arma::Col<T2> taps_;
+    arma::uword   factor_ = 1;
+    arma::uword   n_in_   = 0;
+    arma::Mat<T1> work_;
+};
+
+namespace fir {
+
+/**
+ * @brief Taps of a CIC decimator of order N and rate R (boxcar of length R convolved
+ * N times), normalized to a unit DC gain.
+ *
+ * The CIC is evaluated in its non-recursive form so that it stays exact in floating
+ * point (the recursive integrators would drift without bound).
+ */
+inline
+arma::vec cic(arma::uword order, arma::uword rate)
+{
+    if (order == 0 || rate == 0)
+        throw dsp_error(Errc::invalid_parameters);
+
+    arma::vec boxcar(rate, arma::fill::ones);
+    arma::vec h = boxcar;
+    for (arma::uword i = 1; i < order; ++i)
+        h = arma::conv(h, boxcar);
+    return h / arma::accu(h);
+}
+
+} /* namespace fir */
+} /* namespace dsp */
@@ -0,0 +1,288 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <filesystem>
+#include <limits>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include <armadillo>
+
+#include "dsp_error.h"
+
+namespace dsp {
+
+/**
+ * @brief Random forest compiled into flat, struct-of-arrays node tables.
+ *
+ * The nodes of each tree are stored breadth-first: the right child of a node is
+ * always next to its left child, so that a node only stores the index of its left
+ * child. Leaves loop on themselves with a +inf threshold, which makes the traversal
+ * branchless: every tree is walked for exactly its depth, for a whole block of
+ * feature vectors at once (vectorizable gathers instead of pointer chasing).
+ *
+ * Class probabilities are averaged over the trees like mlpack::tree::RandomForest
+ * and written straight into the caller's buffer.
+ *
+ * All the tables live in a single read-only block with the same layout in memory
+ * and on disk, so a saved model is loaded by mapping the file without any parsing.
+ * Copies of a FlatForest share that block.
+ */
+class FlatForest
+{
+public:
+    FlatForest() = default;
+
+    /**
+     * @brief Compile a trained mlpack random forest with binary numeric splits.
+     *
+     * mlpack doesn't expose the split values, they are recovered exactly by a
+     * bisection over the ordered doubles with DecisionTree::CalculateDirection.
+     */
+    template<typename ForestType>
+    static FlatForest compile(const ForestType& rf);
+
+    /**
+     * @brief Map a model saved with `save`.
+     *
+     * The mapping is shared by all the forests loaded from the same file in the
+     * process and released with the last of them (a file modified since it was
+     * mapped is mapped again).
+     *
+     * @throw dsp_error(Errc::invalid_model) if the file isn't a model or one of its
+     *        node, feature or leaf indices is out of bounds
+     */
+    static FlatForest load(const std::filesystem::path& filename);
+
+    /**
+     * @brief Save the model, atomically replacing the file (the forests already
+     * loaded from it keep the previous version).
+     */
+    void save(const std::filesystem::path& filename) const;
+
+    /**
+     * @brief Compute the class probabilities of a batch of feature vectors.
+     *
+     * @param x Feature vectors (one per column, n_features() rows)
+     * @param n_samples Number of feature vectors
+     * @param out Output, n_out probabilities per column starting at class cls_beg
+     * @param cls_beg First class written
+     * @param n_out Number of classes written per sample
+     */
+    template<typename T>
+    void predict(const T * x, arma::uword n_rows, arma::uword n_samples,
+                 T * out, arma::uword cls_beg, arma::uword n_out) const;
+
+    arma::uword n_trees()    const {return header_ ? header_->n_trees    : 0;}
+    arma::uword n_nodes()    const {return header_ ? header_->n_nodes    : 0;}
+    arma::uword n_classes()  const {return header_ ? header_->n_classes  : 0;}
+    arma::uword n_features() const {return header_ ? header_->n_features : 0;}
+    bool        empty()      const {return header_ == nullptr;}
+
+private:
+    static constexpr arma::uword block_size = 16;
+
+    struct Header
+    {
+        char     magic[8];
+        uint32_t version;
+        uint32_t n_classes;
+        uint32_t n_features;
+        uint32_t n_trees;
+        uint64_t n_nodes;
+        uint64_t n_leaves;
+        uint64_t size;      /**< total size of the block in bytes */
+    };
+
+    /** Tables filled during the compilation */
+    struct Tables
+    {
+        uint32_t n_classes  = 0;
+        uint32_t n_features = 0;
+        std::vector<uint32_t> roots;
+        std::vector<uint32_t> depths;
+        std::vector<uint32_t> feature;
+        std::vector<double>   threshold;
+        std::vector<uint32_t> child;
+        std::vector<uint32_t> leaf;
+        std::vector<double>   probs;
+    };
+
+    std::shared_ptr<const void> storage_;
+    const Header * header_ = nullptr;
+
+    // per tree
+    const uint32_t * roots_     = nullptr;
+    const uint32_t * depths_    = nullptr;
+
+    // per node
+    const uint32_t * feature_   = nullptr;
+    const double   * threshold_ = nullptr;
+    const uint32_t * child_     = nullptr; /**< left child (right = left + 1), self for leaves */
+    const uint32_t * leaf_      = nullptr; /**< row in the leaf table (leaves only) */
+
+    // per leaf
+    const double   * probs_     = nullptr; /**< n_classes probabilities per leaf */
+
+    static FlatForest pack(const Tables& t);
+    void bind(std::shared_ptr<const void> storage, size_t size);
+
+    template<typename TreeType>
+    static double split_threshold(const TreeType& node, arma::uword dim);
+};
+
+template<typename TreeType>
+inline
+double FlatForest::split_threshold(const TreeType& node, arma::uword dim)
+{
+    // map doubles to unsigned integers with the same ordering
+    auto to_key = [](double d) {
+        uint64_t u;
+        std::memcpy(&u, &d, sizeof(u));
+        return (u >> 63) ? ~u : u | (uint64_t(1) << 63);
+    };
+    auto to_double = [](uint64_t k) {
+        uint64_t u = (k >> 63) ? k & ~(uint64_t(1) << 63) : ~k;
+        double d;
+        std::memcpy(&d, &u, sizeof(d));
+        return d;
+    };
+
+    arma::vec point(dim + 1, arma::fill::zeros);
+    auto direction = [&](uint64_t k) {
+        point[dim] = to_double(k);
+        return node.CalculateDirection(point);
+    };
+
+    const double inf = std::numeric_limits<double>::infinity();
+    uint64_t lo = to_key(-inf);
+    uint64_t hi = to_key(inf);
+    if (direction(hi) == 0)
+        return inf;
+    if (direction(lo) != 0)
+        return -inf;
+
+    // invariant: direction(lo) == 0 (left), direction(hi) == 1 (right)
+    while (hi - lo > 1) {
+        uint64_t mid = lo + (hi - lo) / 2;
+        if (direction(mid) == 0)
+            lo = mid;
+        else
+            hi = mid;
+    }
+    return to_double(lo);
+}
+
+template<typename ForestType>
+inline
+FlatForest FlatForest::compile(const ForestType& rf)
+{
+    Tables f;
+    if (rf.NumTrees() == 0)
+        throw dsp_error(Errc::invalid_model);
+    f.n_classes = rf.Tree(0).NumClasses();
+
+    using TreeType = std::decay_t<decltype(rf.Tree(0))>;
+    const double inf = std::numeric_limits<double>::infinity();
+
+    for (size_t t = 0; t < rf.NumTrees(); ++t) {
+        // breadth-first walk, siblings are pushed together
+        std::deque<std::pair<const TreeType*, uint32_t>> queue;
+        const uint32_t root = f.feature.size();
+        f.roots.push_back(root);
+        f.feature.push_back(0);
+        f.threshold.push_back(inf);
+        f.child.push_back(root);
+        f.leaf.push_back(0);
+        queue.emplace_back(&rf.Tree(t), 1);
+
+        uint32_t depth = 0;
+        uint32_t id = root;
+        while (!queue.empty()) {
+            auto [node, level] = queue.front();
+            queue.pop_front();
+            depth = std::max(depth, level);
+
+            if (node->NumChildren() == 0) {
+                arma::vec point(f.n_features + 1, arma::fill::zeros);
+                arma::vec p;
+                size_t prediction;
+                node->Classify(point, prediction, p);
+                f.leaf[id] = f.probs.size() / f.n_classes;
+                f.probs.insert(f.probs.end(), p.begin(), p.end());
+            } else if (node->NumChildren() == 2) {
+                const uint32_t dim = node->SplitDimension();
+                f.n_features   = std::max(f.n_features, dim + 1);
+                f.feature[id]   = dim;
+                f.threshold[id] = split_threshold(*node, dim);
+                f.child[id]     = f.feature.size();
+                for (size_t c = 0; c < 2; ++c) {
+                    f.feature.push_back(0);
+                    f.threshold.push_back(inf);
+                    f.child.push_back(f.feature.size() - 1);
+                    f.leaf.push_back(0);
+                    queue.emplace_back(&node->Child(c), level + 1);
+                }
+            } else {
+                // only binary numeric splits are supported
+                throw dsp_error(Errc::invalid_model);
+            }
+            id++;
+        }
+        // number of steps to reach the deepest leaf
+        f.depths.push_back(depth - 1);
+    }
+
+    return pack(f);
+}
+
+template<typename T>
+inline
+void FlatForest::predict(const T * x, arma::uword n_rows, arma::uword n_samples,
+                         T * out, arma::uword cls_beg, arma::uword n_out) const
+{
+    const uint32_t * feature   = feature_;
+    const double   * threshold = threshold_;
+    const uint32_t * child     = child_;
+    const uint32_t * leaf      = leaf_;
+    const double   * probs     = probs_;
+    const arma::uword n_cls    = n_classes();
+    const double     scale     = 1.0 / static_cast<double>(n_trees());
+
+    std::fill(out, out + n_out * n_samples, T(0));
+
+    for (arma::uword beg = 0; beg < n_samples; beg += block_size) {
+        const arma::uword n = std::min(block_size, n_samples - beg);
+        const T * xb = x + beg * n_rows;
+        T * ob = out + beg * n_out;
+
+        for (arma::uword t = 0; t < n_trees(); ++t) {
+            uint32_t idx[block_size];
+            for (arma::uword s = 0; s < n; ++s)
+                idx[s] = roots_[t];
+
+            for (uint32_t d = 0; d < depths_[t]; ++d) {
+#pragma omp simd
+                for (arma::uword s = 0; s < n; ++s) {
+                    const uint32_t i = idx[s];
+                    idx[s] = child[i] + (xb[s * n_rows + feature[i]] > threshold[i]);
+                }
+            }
+
+            for (arma::uword s = 0; s < n; ++s) {
+                const double * p = probs + leaf[idx[s]] * n_cls + cls_beg;
+                for (arma::uword c = 0; c < n_out; ++c)
+                    ob[s * n_out + c] += p[c];
+            }
+        }
+    }
+
+    for (arma::uword i = 0; i < n_out * n_samples; ++i)
+        out[i] *= scale;
+}
+
+} /* namespace dsp */
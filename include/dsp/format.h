@@ -1,5 +1,7 @@
 #pragma once
 
+#include <string>
+
 #include <armadillo>
 
 namespace dsp {
@@ -9,28 +11,58 @@ enum class Contract {
     supported_format,
 };
 
+/**
+ * @brief Memory layout of a chunk.
+ */
+enum class Layout {
+    time_major,    /**< each column is the time series of a channel (default) */
+    channel_major, /**< each slice is stored transposed: the channels of a time step
+                        are contiguous */
+};
+
 /**
  * @brief Format of a chunck
+ *
+ * The dimensions are logical (rows = time, cols = channels, slices = groups of
+ * channels) whatever the layout: a channel_major chunk is stored as a
+ * (n_cols, n_rows, n_slices) cube.
  */
 struct Format
 {
     arma::uword n_rows   = 0;
     arma::uword n_cols   = 0;
     arma::uword n_slices = 0;
+    Layout      layout   = Layout::time_major;
 };
 
+/**
+ * @brief Same dimensions, regardless of the layout.
+ */
 inline
-bool operator==(const Format& lhs, const Format& rhs)
+bool same_shape(const Format& lhs, const Format& rhs)
 {
     return (lhs.n_rows == rhs.n_rows) &&
         (lhs.n_cols == rhs.n_cols) &&
         (lhs.n_slices == rhs.n_slices);
 }
 
+inline
+bool operator==(const Format& lhs, const Format& rhs)
+{
+    return same_shape(lhs, rhs) && lhs.layout == rhs.layout;
+}
+
 inline
 bool operator!=(const Format& lhs, const Format& rhs)
 {
     return !(lhs == rhs);
 }
 
+inline
+std::string to_string(const Format& f)
+{
+    return "(" + std::to_string(f.n_rows) + ", " + std::to_string(f.n_cols) + ", " +
+        std::to_string(f.n_slices) + (f.layout == Layout::channel_major ? ", T" : "") + ")";
+}
+
 } /* namespace dsp */
@@ -0,0 +1,209 @@
+#pragma once
+
+#include <any>
+#include <atomic>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "common/log.h"
+
+#include "dsp_error.h"
+#include "filter.h"
+#include "format.h"
+#include "pipeline.h"
+
+namespace dsp {
+
+/**
+ * @brief Parameters of a filter created by name (see Registry).
+ */
+using Params = std::map<std::string, std::any>;
+
+/**
+ * @brief Get a parameter, converting between arithmetic types.
+ *
+ * @throw dsp_error(Errc::invalid_parameters) if the parameter is missing or of the
+ *        wrong type
+ */
+template<typename T>
+T param(const Params& params, const std::string& key)
+{
+    auto it = params.find(key);
+    if (it == params.end())
+        throw dsp_error(Errc::invalid_parameters, "missing parameter '" + key + "'");
+
+    const std::any& v = it->second;
+    if (auto p = std::any_cast<T>(&v))
+        return *p;
+    if constexpr (std::is_arithmetic_v<T>) {
+        if (auto p = std::any_cast<int>(&v))         return static_cast<T>(*p);
+        if (auto p = std::any_cast<unsigned>(&v))    return static_cast<T>(*p);
+        if (auto p = std::any_cast<long>(&v))        return static_cast<T>(*p);
+        if (auto p = std::any_cast<arma::uword>(&v)) return static_cast<T>(*p);
+        if (auto p = std::any_cast<double>(&v))      return static_cast<T>(*p);
+    }
+    throw dsp_error(Errc::invalid_parameters, "parameter '" + key + "' has the wrong type");
+}
+
+template<typename T>
+T param(const Params& params, const std::string& key, const T& def)
+{
+    return params.count(key) ? param<T>(params, key) : def;
+}
+
+/**
+ * @brief Type-erased factories of filters, by type name.
+ *
+ * The filters of the library are registered with their data types in the name,
+ * e.g. "iir<cx_double>", "roll<double>" (see src/registry.cpp). Applications add
+ * their own filters to the same registry.
+ */
+class Registry
+{
+public:
+    using Factory = std::function<std::unique_ptr<Filter>(common::Logger, const std::string&,
+                                                          const Params&)>;
+
+    /**
+     * @brief Registry of the process, with the filters of the library.
+     */
+    static Registry& instance();
+
+    void add(const std::string& type, Factory factory);
+    bool contains(const std::string& type) const {return factories_.count(type);}
+    const Factory& factory(const std::string& type) const;
+
+private:
+    std::map<std::string, Factory> factories_;
+};
+
+/**
+ * @brief Description of a pipeline: filters, links & formats.
+ *
+ * Only the formats that can't be deduced have to be given: the outputs of the
+ * sources & the fields that the filters can't derive from their inputs (e.g. the
+ * output size of a Roll), see Pipeline::negotiate_format.
+ *
+ * The description can be instantiated any number of times, e.g. to spin up one
+ * pipeline per device. The first instantiation validates the description &
+ * resolves the formats of all the pads, which are kept: the later ones restore
+ * them, so that the filters are only constructed, linked & checked (their
+ * negotiate_format, where the FFTW plans are made, FFTW reusing the wisdom of the
+ * first planning). Nothing else is shared between the pipelines. Changing the
+ * description drops the resolved formats.
+ *
+ * @code
+ * Graph g;
+ * g.add("iir", "iir<cx_double>", {{"b", b}, {"a", a}})
+ *  .add("fd", "fd<cx_double>", {{"nfft", 64}})
+ *  .link<arma::cx_double>("source", "out", "iir", "in")
+ *  .link<arma::cx_double>("iir", "out", "fd", "in")
+ *  .set_format("source", "out", fmt_in)
+ *  ...;
+ * auto pipeline = g.instantiate(logger);
+ * @endcode
+ */
+class Graph
+{
+public:
+    using Factory = std::function<std::unique_ptr<Filter>(common::Logger, const std::string&)>;
+
+    /**
+     * @brief Add a filter created by type name from the registry.
+     *
+     * @throw dsp_error(Errc::invalid_graph) if the type isn't registered or the
+     *        name is already used
+     */
+    Graph& add(const std::string& name, const std::string& type, const Params& params = {},
+               const Registry& registry = Registry::instance());
+
+    /**
+     * @brief Add a filter created by a custom factory (called with the filter name).
+     */
+    Graph& add(const std::string& name, Factory factory);
+
+    template<typename T>
+    Graph& link(const std::string& src, const std::string& src_pad,
+                const std::string& dst, const std::string& dst_pad)
+    {
+        Edge e {src, src_pad, dst, dst_pad,
+                [](Pipeline& p, Filter * s, const std::string& sp, Filter * d, const std::string& dp) {
+                    p.link<T>(s, sp, d, dp);
+                }};
+        edges_.push_back(std::move(e));
+        invalidate();
+        return *this;
+    }
+
+    /**
+     * @brief Set the format of an output pad (fields left to 0 are derived).
+     */
+    Graph& set_format(const std::string& name, const std::string& pad, const Format& fmt);
+
+    /**
+     * @brief Check the description.
+     *
+     * @throw dsp_error(Errc::invalid_graph) describing the first error found
+     */
+    void validate() const;
+
+    /**
+     * @brief Create a pipeline from the description & negotiate its formats (with
+     * the pads resolved by the first call, see Graph).
+     *
+     * Can be called concurrently.
+     *
+     * @throw dsp_error with the node, pad or link at fault
+     */
+    std::unique_ptr<Pipeline> instantiate(common::Logger logger) const;
+
+private:
+    using Connect = std::function<void(Pipeline&, Filter*, const std::string&,
+                                       Filter*, const std::string&)>;
+
+    struct Node
+    {
+        std::string                   name;
+        Factory                       factory;
+        std::map<std::string, Format> formats; /**< output pad formats */
+    };
+
+    struct Edge
+    {
+        std::string src, src_pad, dst, dst_pad;
+        Connect     connect;
+
+        std::string name() const {return src + "." + src_pad + " -> " + dst + "." + dst_pad;}
+    };
+
+    /**
+     * Pads of a filter resolved by the first instantiation
+     */
+    struct Pads
+    {
+        std::map<std::string, Pad> inputs;
+        std::map<std::string, Pad> outputs;
+    };
+
+    std::vector<Node>         nodes_;
+    std::vector<Edge>         edges_;
+    mutable std::atomic<bool> validated_ {false};
+
+    mutable std::map<std::string, Pads> resolved_; /**< by filter name */
+    mutable std::mutex                  mutex_;    /**< protects resolved_ */
+
+    /**
+     * The description changed: validate it & resolve the formats again
+     */
+    void invalidate();
+
+    const Node * find(const std::string& name) const;
+    Node       * find(const std::string& name);
+};
+
+} /* namespace dsp */
@@ -36,7 +36,7 @@ public:
 
         auto input    = dynamic_cast<Link<T1>*>(inputs_.at("in"));
         auto output   = dynamic_cast<Link<T1>*>(outputs_.at("out"));
-        auto chunk_in = std::make_shared<Chunk<T1>>();
+        typename Link<T1>::const_elem_type chunk_in;
 
         if (!input->pop(chunk_in)) {
             if (input->eof())
@@ -44,45 +44,79 @@ public:
             return 0;
         }
 
+        // batched path: the chunks already queued are filtered together, channel by
+        // channel, so that the state of a channel stays in cache
+        std::vector<typename Link<T1>::const_elem_type> chunks_in {std::move(chunk_in)};
+        if (batch_size() != 1)
+            input->pop_queued(chunks_in, batch_size() ? batch_size() - 1 : 0);
+
+        // filter in place (a chunk is copied only if it's shared with another branch)
         const auto size = output->format();
-        auto chunk_out = std::make_shared<Chunk<T1>>(chunk_in->timestamp, chunk_in->sample_period,
-                                                     size);
+        std::vector<typename Link<T1>::elem_type> chunks;
+        for (auto& c: chunks_in) {
+            auto chunk = input->make_writable(std::move(c));
+            if (verbose_)
+                chunk->print();
+            if (chunk->header.has(chunk_flag::discontinuity | chunk_flag::invalid))
+                log_debug(logger_, "{}: discontinuity at chunk {}, state reset", name_,
+                          chunk->header.seq);
+            chunks.push_back(std::move(chunk));
+        }
+
         uint n = 0;
         for (uint k = 0; k < size.n_slices; k++) {
             for (uint j = 0; j < size.n_cols; j++) {
-                auto in_ptr  = chunk_in->slice_colptr(k, j);
-                auto out_ptr = chunk_out->slice_colptr(k, j);
-                arma::Col<T1> in(in_ptr, size.n_rows, false, true);
-                arma::Col<T1> out(out_ptr, size.n_rows, false, true);
-                out = filters_[n].filter(in);
+                auto& f = filters_[n];
+                for (auto& c: chunks) {
+                    T1 * ptr = c->slice_colptr(k, j);
+                    // the state doesn't carry over a gap
+                    if (c->header.has(chunk_flag::discontinuity | chunk_flag::invalid))
+                        restart(n, ptr, size.n_rows);
+                    for (uint i = 0; i < size.n_rows; i++)
+                        ptr[i] = f(ptr[i]);
+                }
                 n++;
             }
         }
 
-        if (verbose_) {
-            chunk_in->print();
-            chunk_out->print();
+        for (auto& c: chunks) {
+            if (verbose_)
+                c->print();
+            output->push(c);
         }
-
-        output->push(chunk_out);
         return 1;
     }
 
     void reset() override
     {
-        /* TODO: todo <30-10-20, cneyton> */
+        clear();
+    }
+
+    void propagate_format() override
+    {
+        derive_output_format(input_pads_["in"].format, "out");
     }
 
     Contract negotiate_format() override
     {
+        if (!time_major_pads())
+            return Contract::unsupported_format;
+
         if (input_pads_["in"].format != output_pads_["out"].format)
             return Contract::unsupported_format;
 
-        // Allocate and init filters
+        // the states are kept if nothing changed (e.g. restored configuration after a
+        // failed Pipeline::reconfigure)
         auto fmt = input_pads_["in"].format;
+        if (!coeffs_changed_ && fmt == fmt_)
+            return Contract::supported_format;
+
+        // Allocate and init filters
         filters_ = std::vector<sp::IIR_filt<T1, T2, T1>>(fmt.n_cols * fmt.n_slices);
         std::for_each(filters_.begin(), filters_.end(), [&](auto& f){f.clear();});
         std::for_each(filters_.begin(), filters_.end(), [&](auto& f){f.set_coeffs(b_, a_);});
+        fmt_            = fmt;
+        coeffs_changed_ = false;
 
         return Contract::supported_format;
     }
@@ -92,6 +126,26 @@ public:
         std::for_each(filters_.begin(), filters_.end(), [&](auto& f){f.clear();});
     }
 
+    /**
+     * @brief Warm start after a discontinuity: the state is settled by feeding the
+     * first sample of each channel n times, instead of starting from a zero state
+     * (0, default).
+     */
+    void set_warm_up(arma::uword n) {warm_up_ = n;}
+
+    /**
+     * @brief Change the coefficients (applied at the next negotiation, see
+     * Pipeline::reconfigure).
+     */
+    void set_coefficients(const arma::Col<T2>& b, const arma::Col<T2>& a)
+    {
+        if (b.is_empty() || a.is_empty())
+            throw dsp_error(Errc::invalid_parameters);
+        b_ = b;
+        a_ = a;
+        coeffs_changed_ = true;
+    }
+
     void load_parameters(std::filesystem::path filename)
     {
         auto a = cnpy::npz_load(filename, "a");
@@ -110,6 +164,21 @@ private:
     arma::Col<T2> b_;
     arma::Col<T2> a_;
     std::vector<sp::IIR_filt<T1, T2, T1>> filters_;
+    Format      fmt_;                   /**< format of filters_ */
+    bool        coeffs_changed_ = true; /**< since the last negotiation */
+    arma::uword warm_up_ = 0;
+
+    /**
+     * @brief Restart the filter of channel n at x, the first sample after a gap
+     */
+    void restart(uint n, const T1 * x, arma::uword n_rows)
+    {
+        filters_[n].clear();
+        if (n_rows == 0)
+            return;
+        for (arma::uword i = 0; i < warm_up_; i++)
+            filters_[n](x[0]);
+    }
 };
 
 } /* namespace filter */
@@ -0,0 +1,294 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <deque>
+#include <limits>
+#include <memory>
+#include <string>
+#include <tuple>
+#include <utility>
+
+#include "common/log.h"
+#include "filter.h"
+#include "link.h"
+
+namespace dsp::filter {
+
+/**
+ * @brief What a Join does with a chunk that can't be matched with the other inputs.
+ */
+enum class LatePolicy {
+    drop,    /**< discard the chunk with a warning */
+    partial, /**< process it alone, the missing inputs being null */
+    fail,    /**< throw dsp_error(Errc::misaligned_chunks) */
+};
+
+/**
+ * @brief Base class of the filters combining several inputs chunk by chunk.
+ *
+ * The chunks of each input are buffered in a queue and the sets of chunks whose
+ * timestamps are within `tolerance` ns of each other are handed to `process`, oldest
+ * first. A chunk is unmatched (late) when the heads of the other inputs are already
+ * more recent, when it's older than the last processed set, or when another input has
+ * ended: it's then handled with the LatePolicy.
+ *
+ * Each input buffers at most `max_queue` chunks, which bounds the skew between the
+ * branches: when a queue is full the inputs missing from the oldest set are more
+ * than max_queue chunks behind (or stalled), so that set is late too. The links are
+ * thus always consumed and a stalled branch doesn't pile up the chunks of the others
+ * upstream.
+ *
+ * @tparam Ts Data types of the inputs
+ */
+template<typename... Ts>
+class Join: public Filter
+{
+public:
+    static constexpr std::size_t n_inputs = sizeof...(Ts);
+
+    using Chunks = std::tuple<typename Link<Ts>::const_elem_type...>;
+
+    /**
+     * @param pads Name of the input pads, in the order of Ts
+     * @param tolerance Maximum difference between the timestamps of a set in ns
+     * @param max_queue Maximum number of chunks buffered per input (i.e. maximum skew
+     *        between the inputs)
+     * @param policy Handling of the unmatched chunks
+     */
+    Join(common::Logger logger, std::string_view name,
+         const std::array<std::string, n_inputs>& pads, int64_t tolerance = 0,
+         arma::uword max_queue = 16, LatePolicy policy = LatePolicy::drop):
+        Filter(logger, name),
+        pads_(pads), tolerance_(tolerance), max_queue_(max_queue), policy_(policy)
+    {
+        for (auto& p: pads_) {
+            Pad in {.name = p, .format = Format()};
+            input_pads_.insert({in.name, in});
+        }
+
+        if (max_queue_ == 0)
+            throw dsp_error(Errc::invalid_parameters);
+    }
+
+    int activate() override
+    {
+        log_debug(logger_, "{} filter activated", name_);
+
+        int ret = 0;
+        while (true) {
+            // refilled after each set, so that the links don't grow behind full queues
+            fill();
+
+            std::array<bool, n_inputs>        has;
+            std::array<int64_t, n_inputs>     ts;
+            const bool full = heads(has, ts);
+
+            bool all = true, any = false, ended = false;
+            int64_t oldest = std::numeric_limits<int64_t>::max();
+            int64_t newest = std::numeric_limits<int64_t>::min();
+            for (std::size_t i = 0; i < n_inputs; ++i) {
+                all = all && has[i];
+                any = any || has[i];
+                if (has[i]) {
+                    oldest = std::min(oldest, ts[i]);
+                    newest = std::max(newest, ts[i]);
+                } else {
+                    ended  = ended || input_eof(i);
+                }
+            }
+
+            if (!any)
+                break;
+
+            if (all && newest - oldest <= tolerance_) {
+                // matched set
+                emit(has, ts, oldest);
+                ret = 1;
+                continue;
+            }
+
+            // the oldest chunks can't be matched: either a more recent chunk is
+            // already waiting on another input, a missing input has ended or is more
+            // than max_queue chunks behind. Otherwise wait for the missing inputs
+            if (all || ended || full) {
+                late(has, ts, oldest);
+                ret = 1;
+                continue;
+            }
+            break;
+        }
+
+        if (eof()) {
+            for (auto& o: outputs_)
+                o.second->eof_reached();
+        }
+
+        return ret;
+    }
+
+    void reset() override
+    {
+        clear(std::index_sequence_for<Ts...>{});
+        last_ = 0;
+        started_ = false;
+        n_late_ = 0;
+    }
+
+    arma::uword retained_chunks(const std::string&) const override {return max_queue_;}
+
+    std::size_t memory_usage() const override
+    {
+        return std::apply([](const auto&... q) {return (queue_bytes(q) + ... + 0);}, queues_);
+    }
+
+    /**
+     * @brief Number of chunks that could not be matched since the last reset.
+     */
+    arma::uword n_late() const {return n_late_;}
+
+protected:
+    /**
+     * @brief Process a set of chunks with matching timestamps.
+     *
+     * NB: with LatePolicy::partial some of the chunks may be null
+     */
+    virtual void process(const Chunks& chunks) = 0;
+
+private:
+    std::array<std::string, n_inputs> pads_;
+    int64_t     tolerance_;
+    arma::uword max_queue_;
+    LatePolicy  policy_;
+
+    std::tuple<std::deque<typename Link<Ts>::const_elem_type>...> queues_;
+    int64_t     last_    = 0;     /**< timestamp of the last processed set */
+    bool        started_ = false;
+    arma::uword n_late_  = 0;
+
+    template<std::size_t I>
+    using type = std::tuple_element_t<I, std::tuple<Ts...>>;
+
+    template<std::size_t I>
+    Link<type<I>> * input() const
+    {
+        return dynamic_cast<Link<type<I>>*>(inputs_.at(pads_[I]));
+    }
+
+    template<typename F, std::size_t... I>
+    void for_each(F&& f, std::index_sequence<I...>)
+    {
+        (f(std::integral_constant<std::size_t, I>{}), ...);
+    }
+
+    template<typename F>
+    void for_each(F&& f) {for_each(std::forward<F>(f), std::index_sequence_for<Ts...>{});}
+
+    template<std::size_t... I>
+    void clear(std::index_sequence<I...>) {(std::get<I>(queues_).clear(), ...);}
+
+    template<typename Q>
+    static std::size_t queue_bytes(const Q& q)
+    {
+        using T = typename Q::value_type::element_type::elem_type;
+        return q.empty() ? 0 : q.size() * q.front()->n_elem * sizeof(T);
+    }
+
+    void fill()
+    {
+        for_each([this](auto i) {
+            auto& q = std::get<i>(queues_);
+            auto link = input<i>();
+            typename Link<type<i>>::const_elem_type chunk;
+            while (q.size() < max_queue_ && link->pop(chunk))
+                q.push_back(chunk);
+        });
+    }
+
+    bool input_eof(std::size_t n)
+    {
+        bool e = false;
+        for_each([&](auto i) {if (i == n) e = input<i>()->eof() && input<i>()->empty();});
+        return e;
+    }
+
+    /** true once an input has ended & all the buffered chunks have been processed */
+    bool eof()
+    {
+        bool ended = false, empty = true;
+        for_each([&](auto i) {
+            ended = ended || (input<i>()->eof() && input<i>()->empty() &&
+                              std::get<i>(queues_).empty());
+            empty = empty && std::get<i>(queues_).empty();
+        });
+        return ended && (empty || policy_ != LatePolicy::partial);
+    }
+
+    /** @return true if a queue is full */
+    bool heads(std::array<bool, n_inputs>& has, std::array<int64_t, n_inputs>& ts)
+    {
+        bool full = false;
+        for_each([&](auto i) {
+            auto& q = std::get<i>(queues_);
+            has[i] = !q.empty();
+            ts[i]  = q.empty() ? 0 : q.front()->header.timestamp;
+            full   = full || q.size() >= max_queue_;
+        });
+        return full;
+    }
+
+    /** pop the heads within tolerance of `ref` into a set */
+    Chunks take(const std::array<bool, n_inputs>& has,
+                const std::array<int64_t, n_inputs>& ts, int64_t ref)
+    {
+        Chunks chunks;
+        for_each([&](auto i) {
+            if (has[i] && ts[i] - ref <= tolerance_) {
+                auto& q = std::get<i>(queues_);
+                std::get<i>(chunks) = q.front();
+                q.pop_front();
+            }
+        });
+        return chunks;
+    }
+
+    void emit(const std::array<bool, n_inputs>& has,
+              const std::array<int64_t, n_inputs>& ts, int64_t ref)
+    {
+        auto chunks = take(has, ts, ref);
+        if (started_ && ref + tolerance_ < last_) {
+            // older than what was already processed
+            handle_late(chunks, ref);
+            return;
+        }
+        last_    = ref;
+        started_ = true;
+        process(chunks);
+    }
+
+    void late(const std::array<bool, n_inputs>& has,
+              const std::array<int64_t, n_inputs>& ts, int64_t ref)
+    {
+        auto chunks = take(has, ts, ref);
+        handle_late(chunks, ref);
+    }
+
+    void handle_late(const Chunks& chunks, int64_t ts)
+    {
+        n_late_++;
+        switch (policy_) {
+        case LatePolicy::drop:
+            log_warn(logger_, "{}: unmatched chunk dropped (timestamp {} ns)", name_, ts);
+            break;
+        case LatePolicy::partial:
+            last_    = std::max(last_, ts);
+            started_ = true;
+            process(chunks);
+            break;
+        case LatePolicy::fail:
+            throw dsp_error(Errc::misaligned_chunks);
+        }
+    }
+};
+
+} /* namespace dsp::filter */
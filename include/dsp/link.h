@@ -3,45 +3,110 @@
 #include <string>
 #include <memory>
 #include <deque>
+#include <type_traits>
+#include <unordered_set>
 #include <algorithm>
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <vector>
 
 #include <armadillo>
 
 #include "common/log.h"
 
+#include "chunk_header.h"
 #include "dsp_error.h"
 #include "filter.h"
 #include "format.h"
+#include "pages.h"
+#include "pool.h"
+#include "trace.h"
+#include "transpose.h"
 
 namespace dsp {
 
+/**
+ * @brief Chunk of data exchanged between filters.
+ *
+ * Chunks are passed around as shared pointers and a chunk popped from a link may be
+ * shared with other consumers (see Tee): it's handed out as a pointer to const. A
+ * filter that wants to process its input in place must first get exclusive access
+ * with Link::make_writable, which only copies the chunk if it's actually shared.
+ *
+ * The metadata (timestamp, sample period, sequence number & flags) is in the header,
+ * filters deriving a chunk from their input start from a copy of its header.
+ *
+ * A chunk built from a channel_major format stores each slice transposed (see
+ * Layout), `sample` accesses it with the logical (time, channel, slice) indices.
+ */
 template<typename T>
 struct Chunk: public arma::Cube<T>
 {
-    const arma::uword timestamp;     /**< timestamp in ms */
-    const arma::uword sample_period; /**< sample period in ms */
+    ChunkHeader header;
+    Layout      layout = Layout::time_major;
 
-    template<typename... Args>
+    template<typename... Args, typename = std::enable_if_t<
+        std::is_constructible_v<arma::Cube<T>, Args&&...>>>
     Chunk(Args&&... args):
-        arma::Cube<T>(std::forward<Args>(args)...),
-        timestamp {0}, sample_period {1}
+        arma::Cube<T>(std::forward<Args>(args)...)
     {}
 
-    Chunk(arma::uword tmstp, arma::uword sp, const Format& fmt):
-        arma::Cube<T>(fmt.n_rows, fmt.n_cols, fmt.n_slices),
-        timestamp {tmstp}, sample_period {sp}
+    Chunk(const ChunkHeader& h, const Format& fmt):
+        arma::Cube<T>(fmt.layout == Layout::time_major ? fmt.n_rows : fmt.n_cols,
+                      fmt.layout == Layout::time_major ? fmt.n_cols : fmt.n_rows,
+                      fmt.n_slices),
+        header {h}, layout {fmt.layout}
     {}
 
-    template<typename... Args>
-    Chunk(arma::uword tmstp, arma::uword sp, Args&&... args):
-        arma::Cube<T>(std::forward<Args>(args)...),
-        timestamp {tmstp}, sample_period {sp}
+    /**
+     * @brief Chunk stored in huge pages (owned by the chunk).
+     */
+    Chunk(const ChunkHeader& h, const Format& fmt, HugePages&& mem):
+        arma::Cube<T>(static_cast<T*>(mem.data()),
+                      fmt.layout == Layout::time_major ? fmt.n_rows : fmt.n_cols,
+                      fmt.layout == Layout::time_major ? fmt.n_cols : fmt.n_rows,
+                      fmt.n_slices, false, true),
+        header {h}, layout {fmt.layout}, mem_ {std::move(mem)}
     {}
+
+    bool huge_pages() const {return mem_.data() != nullptr;}
+
+    T& sample(arma::uword row, arma::uword col, arma::uword slice)
+    {
+        return layout == Layout::time_major ? this->at(row, col, slice)
+                                            : this->at(col, row, slice);
+    }
+
+    const T& sample(arma::uword row, arma::uword col, arma::uword slice) const
+    {
+        return layout == Layout::time_major ? this->at(row, col, slice)
+                                            : this->at(col, row, slice);
+    }
+
+    arma::uword n_channels() const
+    {
+        return layout == Layout::time_major ? this->n_cols : this->n_rows;
+    }
+
+private:
+    HugePages mem_; /**< empty if the cube allocated its memory */
 };
 
 class LinkInterface
 {
 public:
+    /**
+     * @brief Counters of the chunks that went through the link.
+     */
+    struct Counters
+    {
+        uint64_t n_chunks;          /**< chunks pushed */
+        uint64_t n_invalid;         /**< chunks pushed with the invalid flag */
+        uint64_t n_discontinuities; /**< chunks pushed with the discontinuity flag */
+        uint64_t n_dropped;         /**< chunks dropped by clear or by the consumer */
+    };
+
     LinkInterface(Filter * src, const std::string& src_pad_name,
                   Filter * dst, const std::string& dst_pad_name):
         src_(src), dst_(dst),
@@ -53,24 +118,210 @@ public:
 
     virtual ~LinkInterface() = default;
 
+    /**
+     * @brief Format of the chunks delivered to the destination.
+     */
     const Format& format()  const {return format_;}
 
+    /**
+     * @brief Format of the chunks made by the source (differs from format() by its
+     * layout if the link transposes).
+     */
+    const Format& src_format() const {return src_format_;}
+
+    /**
+     * @brief true if the layouts of the source & destination differ: the chunks
+     * are transposed when they're pushed.
+     */
+    bool transposing() const {return src_format_.layout != format_.layout;}
+
+    /** "src.pad -> dst.pad" */
+    std::string name() const
+    {
+        return src_->name() + "." + src_pad_name_ + " -> " + dst_->name() + "." + dst_pad_name_;
+    }
+
     Contract negotiate_format()
     {
         auto src_fmt = src_->get_output_format(src_pad_name_);
         auto dst_fmt = dst_->get_input_format(dst_pad_name_);
 
-        if (src_fmt != dst_fmt)
+        // the layouts may differ, the link transposes the chunks
+        if (!same_shape(src_fmt, dst_fmt))
+            return Contract::unsupported_format;
+
+        // keep the pool (& the chunks in flight) if the format didn't change
+        if (allocated_ && format_ == dst_fmt && src_format_ == src_fmt)
             return Contract::supported_format;
 
-        format_ = src_fmt;
+        format_     = dst_fmt;
+        src_format_ = src_fmt;
+        allocated_  = true;
+        allocate();
+        n_allocations_++;
         return Contract::supported_format;
     }
 
-    void eof_reached()  {eof_ = 1;}
+    /**
+     * @brief Give the destination input the format of the source output (fields
+     * left to 0 only).
+     */
+    void propagate_format()
+    {
+        dst_->derive_input_format(src_->get_output_format(src_pad_name_), dst_pad_name_);
+    }
+
+    Filter * src() const {return src_;}
+    Filter * dst() const {return dst_;}
+    const std::string& src_pad() const {return src_pad_name_;}
+    const std::string& dst_pad() const {return dst_pad_name_;}
+
+    /**
+     * @brief Drop the chunks waiting in the link.
+     */
+    virtual void clear() {}
+
+    virtual bool empty() const {return true;}
+
+    /**
+     * @brief Ask the source for more data (unless it has ended).
+     *
+     * The source is marked as wanted, not ready: the scheduler only activates it if
+     * it can produce something (see Pipeline::set_scheduling).
+     */
+    void request()
+    {
+        if (!eof_) {
+            src_->set_wanted();
+            if (notify_)
+                notify_();
+        }
+    }
+
+    /**
+     * @brief Reallocate the pool from the calling thread.
+     *
+     * Called by the execution domain of the source filter so that the chunks are
+     * allocated on its NUMA node.
+     */
+    void reallocate() {if (allocated_) allocate();}
+
+    /**
+     * @brief Number of (re)allocations of the pool by the negotiations.
+     */
+    arma::uword n_allocations() const {return n_allocations_;}
+
+    /**
+     * @brief Leave the reallocation of the pool to the execution domain of the
+     * source (see Pipeline::reconfigure).
+     *
+     * @return false if it was already deferred
+     */
+    bool defer_reallocation() {return !deferred_.exchange(true);}
+
+    /**
+     * @brief Reallocate the pool from the calling thread if it was deferred.
+     *
+     * @return true if the pool was reallocated
+     */
+    bool reallocate_deferred()
+    {
+        if (!deferred_.exchange(false))
+            return false;
+        reallocate();
+        return true;
+    }
+
+    /**
+     * @brief Store the large chunks in huge pages (applied at the next negotiation).
+     */
+    void set_huge_pages(bool enable)
+    {
+        if (enable != huge_pages_)
+            allocated_ = false;
+        huge_pages_ = enable;
+    }
+
+    /**
+     * @brief Make the queue safe to use from two threads (link between execution
+     * domains). `notify` is called after each push to wake up the consumer.
+     */
+    void set_concurrent(std::function<void()> notify)
+    {
+        concurrent_ = true;
+        notify_     = std::move(notify);
+    }
+    bool concurrent() const {return concurrent_;}
+
+    /**
+     * @brief Record the queue waits & latencies of the link with the tracer (see
+     * Pipeline::set_tracing).
+     */
+    void set_tracer(trace::Tracer * tracer)
+    {
+        tracer_ = tracer;
+        track_  = tracer->track(name());
+    }
+
+    /**
+     * @brief Mark the end of the stream, the destination is woken up to handle it.
+     */
+    void eof_reached()
+    {
+        eof_ = 1;
+        dst_->set_ready();
+        if (notify_)
+            notify_();
+    }
+
     void reset_eof()    {eof_ = 0;}
     bool eof() const    {return eof_;}
 
+    Counters counters() const
+    {
+        return {n_chunks_, n_invalid_, n_discontinuities_, n_dropped_};
+    }
+
+    /**
+     * @brief Count chunks popped but discarded by the consumer (e.g. invalid data).
+     */
+    void count_dropped(uint64_t n = 1) {n_dropped_ += n;}
+
+    void reset_counters()
+    {
+        n_chunks_ = n_invalid_ = n_discontinuities_ = n_dropped_ = 0;
+        peak_queued_ = n_queued_.load();
+    }
+
+    /**
+     * @name Memory accounting
+     * @{ */
+    /** Number of chunks waiting in the link (doesn't lock the queue) */
+    std::size_t n_queued()          const {return n_queued_;}
+    /** Bytes of the chunks waiting in the link */
+    std::size_t queued_bytes()      const {return n_queued_ * chunk_bytes_;}
+    /** High-water mark of queued_bytes() since the last reset_counters */
+    std::size_t peak_queued_bytes() const {return peak_queued_ * chunk_bytes_;}
+
+    /**
+     * @brief Bytes of the chunks waiting in the link that aren't in `counted` yet
+     * (locks the queue).
+     *
+     * The chunks are added to `counted`: a chunk queued in several links (see Tee)
+     * is only counted by the first one.
+     */
+    virtual std::size_t queued_bytes(std::unordered_set<const void*>&) const {return 0;}
+
+    /**
+     * @brief Drop the oldest chunk waiting in the link (see
+     * Pipeline::MemoryPolicy::degrade), the next chunk popped is flagged as
+     * discontinuous.
+     *
+     * @return false if the link is empty
+     */
+    virtual bool drop_front() {return false;}
+    /**  @} */
+
 
 protected:
     Filter * const src_;
@@ -78,17 +329,89 @@ protected:
     std::string src_pad_name_;
     std::string dst_pad_name_;
     Format  format_;
+    Format  src_format_;
+    bool    allocated_  = false;
+    bool    huge_pages_ = false;
+    arma::uword       n_allocations_ = 0;
+    std::atomic<bool> deferred_ {false};
+
+    bool                  concurrent_ = false;
+    std::function<void()> notify_;
+    mutable std::mutex    mutex_;    /**< protects the queue if concurrent */
+
+    std::atomic<int> eof_ {0};
+
+    std::atomic<uint64_t> n_chunks_ {0};
+    std::atomic<uint64_t> n_invalid_ {0};
+    std::atomic<uint64_t> n_discontinuities_ {0};
+    std::atomic<uint64_t> n_dropped_ {0};
+
+    std::atomic<std::size_t> n_queued_ {0};
+    std::atomic<std::size_t> peak_queued_ {0};
+    std::atomic<std::size_t> chunk_bytes_ {0};  /**< set at allocation */
+    bool                     discontinuity_ = false; /**< flag the next chunk popped */
+
+    trace::Tracer * tracer_ = nullptr;
+    uint32_t        track_  = 0;
+
+    /**
+     * @brief Time of the push if tracing (0 otherwise), the latency since the
+     * ingress of the chunk is recorded.
+     */
+    int64_t trace_push(const ChunkHeader& h)
+    {
+        if (!tracer_ || !tracer_->enabled())
+            return 0;
+        const int64_t t = trace::now();
+        if (h.ingress_last)
+            tracer_->latency(track_, h.trace_id, h.ingress_first, h.ingress_last, t);
+        return t;
+    }
+
+    void trace_pop(const ChunkHeader& h, int64_t pushed)
+    {
+        if (pushed && tracer_ && tracer_->enabled())
+            tracer_->wait(track_, h.trace_id, pushed, trace::now());
+    }
+
+    void count_queued(std::size_t n)
+    {
+        n_queued_ = n;
+        if (n > peak_queued_)
+            peak_queued_ = n;
+    }
+
+    void count_pushed(const ChunkHeader& h)
+    {
+        ++n_chunks_;
+        if (h.has(chunk_flag::invalid))
+            ++n_invalid_;
+        if (h.has(chunk_flag::discontinuity))
+            ++n_discontinuities_;
+    }
+
+    /**
+     * @brief Lock on the queue, only taken if the link is concurrent.
+     */
+    std::unique_lock<std::mutex> lock_queue() const
+    {
+        return concurrent_ ? std::unique_lock<std::mutex>(mutex_)
+                           : std::unique_lock<std::mutex>();
+    }
 
-    int eof_ = 0;
+    /**
+     * @brief Called once the format of the link is known.
+     */
+    virtual void allocate() {}
 };
 
 
-/* TODO: add a pool of chunk to avoid oom <01-04-20, cneyton> */
 template<typename T>
 class Link: public LinkInterface
 {
 public:
-    using elem_type = std::shared_ptr<Chunk<T>>;
+    using elem_type       = std::shared_ptr<Chunk<T>>;       /**< chunk being made */
+    using const_elem_type = std::shared_ptr<const Chunk<T>>; /**< chunk popped */
 
     Link(): LinkInterface(nullptr, "", nullptr, "") {}
     Link(Filter * src, const std::string& src_pad_name,
@@ -97,47 +420,181 @@ public:
 
     virtual ~Link() = default;
 
-    int push(elem_type chunk)
+    using LinkInterface::queued_bytes;
+
+    int push(const_elem_type chunk)
     {
-        chunk_queue_.emplace_back(chunk);
+        count_pushed(chunk->header);
+        if (chunk->layout != format_.layout) {
+            auto t = pool_.acquire(chunk->header);
+            transpose::slices<T>(*chunk, *t);
+            chunk = std::move(t);
+        }
+        const int64_t pushed = trace_push(chunk->header);
+        {
+            auto lk = lock_queue();
+            chunk_queue_.emplace_back(chunk);
+            push_times_.push_back(pushed);
+            count_queued(chunk_queue_.size());
+        }
 
         dst_->set_ready();
+        if (notify_)
+            notify_();
         return 0;
     }
 
-    int pop(elem_type& chunk)
+    int pop(const_elem_type& chunk)
     {
+        auto lk = lock_queue();
         if (chunk_queue_.empty()) {
-            if (!eof_)
-                src_->set_ready();
+            request();
             return 0;
         }
         chunk = chunk_queue_.front();
         chunk_queue_.pop_front();
+        trace_pop(chunk->header, push_times_.front());
+        push_times_.pop_front();
+        count_queued(chunk_queue_.size());
+        if (discontinuity_) {
+            auto writable = make_writable(std::move(chunk));
+            writable->header.flags |= chunk_flag::discontinuity;
+            chunk = std::move(writable);
+            discontinuity_ = false;
+        }
         return 1;
     }
 
-    elem_type front() const
+    /**
+     * @brief Pop the chunks already queued, up to n (0 for no limit), without
+     * requesting more from the source.
+     *
+     * @return number of chunks appended to chunks
+     */
+    arma::uword pop_queued(std::vector<const_elem_type>& chunks, arma::uword n)
+    {
+        arma::uword k = 0;
+        const_elem_type chunk;
+        while (k != n && !empty() && pop(chunk)) {
+            chunks.push_back(std::move(chunk));
+            k++;
+        }
+        return k;
+    }
+
+    const_elem_type front() const
     {
+        auto lk = lock_queue();
         return chunk_queue_.front();
     }
 
     void pop()
     {
+        auto lk = lock_queue();
+        trace_pop(chunk_queue_.front()->header, push_times_.front());
+        chunk_queue_.pop_front();
+        push_times_.pop_front();
+        count_queued(chunk_queue_.size());
+    }
+
+    /**
+     * @brief Get a chunk with the format of the source output from the link pool.
+     *
+     * The header is copied from h, with the next sequence number of the link.
+     *
+     * NB: the content of the chunk is undefined
+     */
+    elem_type make_chunk(const ChunkHeader& h)
+    {
+        auto chunk = transposing() ? src_pool_.acquire(h) : pool_.acquire(h);
+        chunk->header.seq = seq_++;
+        return chunk;
+    }
+
+    void clear() override
+    {
+        auto lk = lock_queue();
+        count_dropped(chunk_queue_.size());
+        chunk_queue_.clear();
+        push_times_.clear();
+        count_queued(0);
+        discontinuity_ = false;
+        seq_ = 0;
+    }
+
+    bool drop_front() override
+    {
+        auto lk = lock_queue();
+        if (chunk_queue_.empty())
+            return false;
         chunk_queue_.pop_front();
+        push_times_.pop_front();
+        count_queued(chunk_queue_.size());
+        count_dropped();
+        discontinuity_ = true;
+        return true;
+    }
+
+    arma::uword size() const
+    {
+        auto lk = lock_queue();
+        return chunk_queue_.size();
+    }
+
+    bool empty() const override
+    {
+        auto lk = lock_queue();
+        return chunk_queue_.empty();
+    }
+
+    std::size_t queued_bytes(std::unordered_set<const void*>& counted) const override
+    {
+        auto lk = lock_queue();
+        std::size_t bytes = 0;
+        for (auto& chunk: chunk_queue_)
+            if (counted.insert(chunk.get()).second)
+                bytes += chunk->n_elem * sizeof(T);
+        return bytes;
     }
 
-    template<class... Args>
-    elem_type make_chunk(Args&&... args)
+    /**
+     * @brief Get exclusive access to a chunk popped from this link.
+     *
+     * The chunk is moved in: if it's still referenced elsewhere (e.g. by the other
+     * outputs of a Tee) a copy taken from the link pool is returned, otherwise the
+     * chunk itself.
+     *
+     * @return the writable chunk
+     */
+    elem_type make_writable(const_elem_type&& chunk)
     {
-        return std::make_shared<Chunk<T>>(std::forward<Args>(args)...);
+        const_elem_type c = std::move(chunk);
+        if (c.use_count() > 1) {
+            auto copy = pool_.acquire(c->header);
+            static_cast<arma::Cube<T>&>(*copy) = *c;
+            return copy;
+        }
+        return std::const_pointer_cast<Chunk<T>>(c);
     }
 
-    arma::uword  size() const {return chunk_queue_.size();}
-    bool        empty() const {return chunk_queue_.empty();}
+    const ChunkPool<T>& pool() const {return pool_;}
 
 private:
-    std::deque<elem_type> chunk_queue_;
+    std::deque<const_elem_type> chunk_queue_;
+    std::deque<int64_t>         push_times_;  /**< of the queued chunks, if tracing */
+    ChunkPool<T>                pool_;
+    ChunkPool<T>                src_pool_;  /**< chunks made by the source if transposing */
+    uint64_t                    seq_ = 0;
+
+    void allocate() override
+    {
+        chunk_bytes_ = format_.n_rows * format_.n_cols * format_.n_slices * sizeof(T);
+        // one chunk being filled by the producer, one being read by the consumer &
+        // the ones the consumer keeps
+        pool_.set_format(format_, 2 + dst_->retained_chunks(dst_pad_name_), huge_pages_);
+        // the chunk being filled is released once transposed
+        src_pool_.set_format(src_format_, transposing() ? 1 : 0, huge_pages_);
+    }
 };
 
 } /* namespace dsp */
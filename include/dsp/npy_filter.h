@@ -0,0 +1,175 @@
+#pragma once
+
+#include <string>
+
+#include <cnpy.h>
+
+#include "common/log.h"
+
+#include "filter.h"
+#include "link.h"
+#include "pipeline.h"
+
+namespace dsp::filter {
+
+/**
+ * @brief Source filter reading a whole recording from a .npy file.
+ *
+ * The file holds a (n_slices, n_cols, n_rows) C-ordered array, i.e. a column-major
+ * (n_rows, n_cols, n_slices) cube. It's pushed chunk by chunk with the format of
+ * the output link, the last incomplete chunk is dropped.
+ */
+template<typename T>
+class NpySource: public Filter
+{
+public:
+    NpySource(common::Logger logger, std::string filename,
+              Period sample_period = Period::ms(1), std::string name = "npy_source"):
+        Filter(logger, name),
+        filename_(filename), sample_period_{sample_period}
+    {
+        Pad p {.name="out", .format=Format()};
+        output_pads_.insert({p.name, p});
+
+        cnpy::NpyArray np_array = cnpy::npy_load(filename_);
+        arma::uword n_rows   = np_array.shape.at(2);
+        arma::uword n_cols   = np_array.shape.at(1);
+        arma::uword n_slices = np_array.shape.at(0);
+
+        data_ = arma::Cube<T>(np_array.data<T>(), n_rows, n_cols, n_slices);
+    }
+
+    int activate() override
+    {
+        log_debug(logger_, "{} filter activated, i = {}", this->name_, i_);
+        auto output = dynamic_cast<Link<T>*>(outputs_.at("out"));
+        auto fmt    = output->format();
+
+        arma::uword row_beg = i_ * fmt.n_rows;
+        arma::uword row_end = (i_+1) * fmt.n_rows;
+        if (row_end <= data_.n_rows) {
+            ChunkHeader header;
+            header.timestamp     = sample_period_.duration(row_beg);
+            header.sample_period = sample_period_;
+            header.trace_id      = trace::next_id();
+            header.ingress_first = header.ingress_last = trace::now();
+            auto chunk = output->make_chunk(header);
+            static_cast<arma::Cube<T>&>(*chunk) = data_.rows(row_beg, row_end - 1);
+            output->push(chunk);
+            i_++;
+            return 1;
+        } else {
+            log_debug(logger_, "eof");
+            output->eof_reached();
+            return 0;
+        }
+    }
+
+    void reset() override
+    {
+        i_ = 0;
+    }
+
+    Contract negotiate_format() override
+    {
+        if (!time_major_pads())
+            return Contract::unsupported_format;
+
+        return Contract::supported_format;
+    }
+
+    arma::SizeCube get_fmt()
+    {
+        return arma::size(data_);
+    }
+
+    std::size_t memory_usage() const override {return data_.n_elem * sizeof(T);}
+
+private:
+    std::string    filename_;
+    arma::Cube<T>  data_;
+    arma::uword    i_ = 0;
+    Period         sample_period_;
+};
+
+/**
+ * @brief Sink filter gathering its input to save it in a .npy file.
+ *
+ * NB: fmt gives the maximum size of the data, the saved array is trimmed to the
+ * chunks actually received.
+ */
+template<typename T>
+class NpySink: public Filter
+{
+public:
+    NpySink(common::Logger logger, arma::SizeCube fmt, std::string_view name = "sink"):
+        Filter(logger, name), data_(arma::Cube<T>(fmt))
+    {
+        Pad p {.name="in", .format=Format()};
+        input_pads_.insert({p.name, p});
+    }
+
+    int activate() override
+    {
+        log_debug(logger_, "{} filter activated, i = {}", name_, i_);
+
+        auto input = dynamic_cast<Link<T>*>(inputs_.at("in"));
+        typename Link<T>::const_elem_type chunk;
+
+        if (!input->pop(chunk))
+            return 0;
+
+
+        if (verbose_)
+            chunk->print();
+
+        data_.rows(i_ * chunk->n_rows, (i_+1) * chunk->n_rows - 1) = *chunk;
+        i_++;
+
+        return 1;
+    }
+
+    void reset() override
+    {
+        i_ = 0;
+    }
+
+    Contract negotiate_format() override
+    {
+        if (!time_major_pads())
+            return Contract::unsupported_format;
+
+        return Contract::supported_format;
+    }
+
+    /**
+     * @brief Run the pipeline until the end of the input & save the data.
+     */
+    void dump(std::string filename)
+    {
+        auto input = dynamic_cast<Link<T>*>(inputs_.at("in"));
+        while (!input->eof()) {
+            activate();
+            this->pipeline_->run();
+        }
+        auto fmt   = input->format();
+        data_.resize(fmt.n_rows * i_, fmt.n_cols, fmt.n_slices);
+        cnpy::npy_save(filename, data_.memptr(), {data_.n_slices, data_.n_cols, data_.n_rows}, "w");
+    }
+
+    /**
+     * @brief Number of chunks received
+     */
+    arma::uword n_chunks() const {return i_;}
+
+    /**
+     * @brief The data is allocated for fmt upfront.
+     */
+    std::size_t memory_usage() const override {return data_.n_elem * sizeof(T);}
+
+private:
+    arma::Cube<T>  data_;
+    arma::uword    i_ = 0;
+};
+
+} /* namespace dsp::filter */
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace dsp {
+
+/**
+ * @brief Memory mapped with 2 MB pages.
+ *
+ * Explicit huge pages (MAP_HUGETLB) are used if the system has some reserved,
+ * otherwise the mapping is aligned on 2 MB & the kernel is asked to back it with
+ * transparent huge pages (madvise). The size is rounded up to a multiple of 2 MB,
+ * so it's only worth it for large allocations (see huge_page_size).
+ *
+ * The memory is zeroed. With prefault the pages are mapped right away by the
+ * calling thread (i.e. on its NUMA node) instead of at the first write.
+ */
+class HugePages
+{
+public:
+    static constexpr std::size_t huge_page_size = 2 * 1024 * 1024;
+
+    /**
+     * @brief Process wide counters of the mappings.
+     */
+    struct Stats
+    {
+        uint64_t n_hugetlb;    /**< mappings backed by reserved huge pages */
+        uint64_t n_thp;        /**< mappings relying on transparent huge pages */
+        uint64_t bytes_mapped; /**< currently mapped */
+    };
+
+    HugePages() = default;
+
+    /**
+     * @throw std::bad_alloc if the memory can't be mapped
+     */
+    HugePages(std::size_t n, bool prefault);
+    ~HugePages();
+
+    HugePages(HugePages&& p) noexcept;
+    HugePages& operator=(HugePages&& p) noexcept;
+
+    HugePages(const HugePages&) = delete;
+    HugePages& operator=(const HugePages&) = delete;
+
+    void *      data()    const {return addr_;}
+    std::size_t size()    const {return size_;}
+    bool        hugetlb() const {return hugetlb_;}
+
+    static Stats stats();
+
+private:
+    void *      addr_    = nullptr;
+    std::size_t size_    = 0;
+    bool        hugetlb_ = false;
+
+    void release();
+};
+
+/**
+ * @brief Page faults of the process (getrusage).
+ */
+struct PageFaults
+{
+    uint64_t minor;
+    uint64_t major;
+
+    static PageFaults now();
+
+    PageFaults operator-(const PageFaults& p) const {return {minor - p.minor, major - p.major};}
+};
+
+} /* namespace dsp */
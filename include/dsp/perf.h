@@ -0,0 +1,79 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+
+namespace dsp::perf {
+
+/**
+ * @brief Hardware counters & elapsed time.
+ *
+ * The counters that can't be read (no PMU access, e.g. perf_event_paranoid or in a
+ * VM) stay at 0.
+ */
+struct Counters
+{
+    int64_t  time_ns       = 0;
+    uint64_t cycles        = 0;
+    uint64_t instructions  = 0;
+    uint64_t cache_misses  = 0; /**< last level cache */
+    uint64_t branch_misses = 0;
+    uint64_t dtlb_misses   = 0; /**< data TLB read misses */
+
+    Counters& operator+=(const Counters& c)
+    {
+        time_ns       += c.time_ns;
+        cycles        += c.cycles;
+        instructions  += c.instructions;
+        cache_misses  += c.cache_misses;
+        branch_misses += c.branch_misses;
+        dtlb_misses   += c.dtlb_misses;
+        return *this;
+    }
+
+    Counters operator-(const Counters& c) const
+    {
+        return {time_ns - c.time_ns, cycles - c.cycles, instructions - c.instructions,
+                cache_misses - c.cache_misses, branch_misses - c.branch_misses,
+                dtlb_misses - c.dtlb_misses};
+    }
+};
+
+/**
+ * @brief Counters of the calling thread (perf_event_open).
+ *
+ * The events are opened as one group at the first use in each thread & read with a
+ * single syscall. Only the user space is counted.
+ */
+class ThreadCounters
+{
+public:
+    static ThreadCounters& current();
+
+    ~ThreadCounters();
+
+    ThreadCounters(const ThreadCounters&) = delete;
+    ThreadCounters& operator=(const ThreadCounters&) = delete;
+
+    /**
+     * @brief Current values, to be subtracted from a later read.
+     */
+    Counters read() const;
+
+    /**
+     * @brief false if the hardware counters can't be opened (only the time is
+     * measured).
+     */
+    bool available() const {return leader_ >= 0;}
+
+private:
+    static constexpr std::size_t n_events = 5;
+
+    int leader_ = -1;
+    std::array<int, n_events> fds_;
+    std::array<int, n_events> index_; /**< position of each event in the group read */
+
+    ThreadCounters();
+};
+
+} /* namespace dsp::perf */
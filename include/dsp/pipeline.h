@@ -1,35 +1,108 @@
 #pragma once
 
+#include <atomic>
 #include <condition_variable>
+#include <functional>
 #include <mutex>
+#include <shared_mutex>
+#include <thread>
 #include <vector>
 #include <map>
 #include <memory>
 #include <chrono>
+#include <string>
 
 #include "common/log.h"
 
+#include "arena.h"
+#include "pages.h"
+#include "perf.h"
+#include "trace.h"
 #include "filter.h"
 #include "link.h"
 #include "dsp_error.h"
+#include "fftw.h"
 
 namespace dsp {
 
 class Pipeline: public common::Log
 {
 public:
+    /**
+     * @brief How the requests of a starved filter (Link::pop on an empty link) are
+     * handled.
+     */
+    enum class Scheduling
+    {
+        eager,  /**< the upstream filter is activated, even if it has no data either */
+        demand, /**< the request walks upstream through the filters without data, only
+                     the ones able to produce (sources or filters with a non-empty
+                     input) are activated */
+    };
+
+    /**
+     * @brief What the pipeline does while its memory usage is over the budget.
+     */
+    enum class MemoryPolicy
+    {
+        backpressure, /**< the sources aren't activated while the other filters have
+                           something to do (data piles up in the sources instead) */
+        degrade,      /**< the oldest chunks of the fullest links are dropped, the
+                           consumers see a discontinuity */
+    };
+
     Pipeline(common::Logger logger);
+    ~Pipeline();
 
     /**
      * @brief Reset filters & links.
      *
-     * For each filter call the reset method and reset eof on
-     * each link.
+     * For each filter call the reset method, drop the chunks waiting in the links &
+     * reset eof on each link.
      */
     void reset();
 
+    /**
+     * @brief Stop activating filters (after the running activation completes).
+     */
+    void pause();
+
+    /**
+     * @brief Resume the activations & wake up the pipeline.
+     */
+    void resume();
+
+    /**
+     * @brief Change the parameters of some filters on a running pipeline.
+     *
+     * Waits for the running activation to complete (chunk boundary), calls `apply`
+     * (e.g. IIR::set_coefficients, FD::set_nfft, Roll::set_skip or
+     * Filter::set_output_format on the listed filters), then re-negotiates the
+     * listed filters & the ones downstream. The link pools & FFTW plans whose
+     * formats are unchanged are reused.
+     *
+     * If the new formats are accepted, that subgraph is reset & the chunks in flight
+     * in it are dropped, the rest of the pipeline keeps its state. Otherwise `revert`
+     * is called to undo `apply`, the previous formats are restored & negotiated again
+     * and the pipeline goes on with the chunks in flight (see negotiation_error).
+     * Only the filters whose parameters were changed may have lost their state in
+     * the failed negotiation.
+     *
+     * The pools of the links whose format changed are reallocated by the execution
+     * domain of their source at its next activation, like at start_domains.
+     *
+     * @param filters Filters modified by apply
+     * @param revert Undo apply (if empty, the parameters changed by apply are kept
+     *        after a failure)
+     */
+    Contract reconfigure(const std::vector<Filter*>& filters, const std::function<void()>& apply,
+                         const std::function<void()>& revert = {});
+
     /**
      * @brief Run until there is no more filter to activate
+     *
+     * Only the filters that aren't assigned to an execution domain are activated by
+     * the calling thread.
      */
     void run();
 
@@ -39,7 +112,20 @@ public:
     void stop();
 
     /**
-     * @brief Wait for a filter in the pipeline to be ready
+     * @brief Set the handling of the requests for data (Scheduling::demand by default).
+     */
+    void set_scheduling(Scheduling s) {scheduling_ = s;}
+    Scheduling scheduling() const {return scheduling_;}
+
+    /**
+     * @brief Number of requests forwarded upstream instead of activating the
+     * starved filter (Scheduling::demand).
+     */
+    arma::uword n_forwarded() const {return n_forwarded_;}
+
+    /**
+     * @brief Wait for a filter of the pipeline (outside of the execution domains) to
+     * be ready
      */
     void wait();
 
@@ -66,7 +152,149 @@ public:
      */
     Filter * get_filter(const std::string& name);
 
-    Contract negotiate_format();
+    /**
+     * @brief Negotiate the formats of all the filters & links.
+     *
+     * The filters are visited in topological order: the unset fields of the input
+     * formats are taken from the outputs they're linked to, then each filter derives
+     * its output formats (Filter::propagate_format) & checks them. Only the formats
+     * that can't be deduced (sources, output size of Roll or Buffer...) need to be
+     * set. The link pools are then allocated with the resolved formats.
+     *
+     * Serialized with the other pipelines of the process since the filters create
+     * their FFTW plans there (see fftw::planner_mutex).
+     *
+     * @param propagate false if the pads are already resolved (e.g. restored from a
+     *        pipeline built from the same description, see Graph::instantiate): the
+     *        filters & links only check their formats
+     */
+    Contract negotiate_format(bool propagate = true);
+
+    /**
+     * @brief Description of the last negotiation failure (filter or link & formats)
+     */
+    const std::string& negotiation_error() const {return negotiation_error_;}
+
+    /**
+     * @brief Set the maximum number of consecutive activations of a ready filter.
+     *
+     * By default (1) the scheduler activates one filter at a time. For offline
+     * processing a larger batch lets each filter go through all the chunks available
+     * on its inputs (up to n, 0 for no limit) before the next one runs, so that its
+     * state & coefficients stay in cache. Each link is still consumed in order hence
+     * the results are identical to the streaming mode, only the chunks in flight
+     * (and thus the pools) grow with the batch size.
+     *
+     * The hot filters with a per-channel state (IIR, Decimate) also have a batched
+     * path: each activation pops up to n of the queued chunks & runs each channel
+     * through all of them before moving to the next channel. The other filters
+     * still process one chunk per activation.
+     */
+    void set_batch_size(arma::uword n)
+    {
+        batch_size_ = n;
+        for (auto& [name, f]: filters_)
+            f->set_batch_size(n);
+    }
+    arma::uword batch_size() const {return batch_size_;}
+
+    /**
+     * @name Execution domains
+     *
+     * By default all the filters are activated by the thread calling run. A filter
+     * or a whole subgraph can instead be assigned to an execution domain: a thread
+     * pinned to a set of CPUs (e.g. the cores of one socket) that activates the
+     * filters of the domain as they become ready.
+     *
+     * The pools of the links are reallocated by the domain of their source filter,
+     * so with the first-touch policy of Linux the chunks live on the NUMA node where
+     * they're written. The links between two domains (or between a domain & the
+     * calling thread) are the only hand-off points: their queue is protected by a
+     * mutex & a push wakes up the consumer domain. The other links are left
+     * lock-free.
+     *
+     * The domains are set up before start_domains, after the negotiation.
+     * @{ */
+
+    /**
+     * @param cpus CPUs the domain thread is pinned to (not pinned if empty)
+     */
+    void add_domain(const std::string& name, const std::vector<int>& cpus);
+
+    /**
+     * @brief Activate the filters from the thread of the given domain.
+     */
+    void assign(const std::vector<Filter*>& filters, const std::string& domain);
+
+    /**
+     * @brief Start the domain threads (after negotiate_format).
+     */
+    void start_domains();
+
+    /**
+     * @brief Stop & join the domain threads (after their running activation).
+     */
+    void stop_domains();
+    /**  @} */
+
+    /**
+     * @brief Arena of the coroutine frames of the filters (see CoroFilter).
+     */
+    FrameArena& frame_arena() {return frame_arena_;}
+
+    /**
+     * @brief Store the chunks of at least 2 MB in prefaulted huge pages (applied at
+     * the next negotiation, see HugePages).
+     */
+    void set_huge_pages(bool enable) {huge_pages_ = enable;}
+
+    /**
+     * @brief Page faults of the process since the creation of the pipeline.
+     */
+    PageFaults page_faults() const {return PageFaults::now() - faults_base_;}
+
+    /**
+     * @name Memory accounting
+     *
+     * The memory usage is the sum of the chunks waiting in the links (once for a
+     * chunk queued in several links) & of the memory held by the filters
+     * (Filter::memory_usage, accounted after each of their activations & when a
+     * source is held back). It's checked against the budget after each activation.
+     * @{ */
+    /**
+     * @param bytes Budget (0: none)
+     */
+    void set_memory_budget(std::size_t bytes, MemoryPolicy policy = MemoryPolicy::backpressure);
+    std::size_t memory_budget() const {return budget_;}
+
+    std::size_t memory_usage() const;
+    /** High-water mark of memory_usage() */
+    std::size_t peak_memory_usage() const {return peak_memory_;}
+
+    /** Number of source activations held back by the backpressure */
+    arma::uword n_throttled() const {return n_throttled_;}
+    /**  @} */
+
+    /**
+     * @brief Record the activations of the filters, the queue waits of the chunks &
+     * their latency since the ingress of their frames (see trace::Tracer).
+     *
+     * The recorded events are exported with tracer().write_chrome_trace.
+     */
+    void set_tracing(bool enable) {tracer_.enable(enable);}
+    trace::Tracer& tracer() {return tracer_;}
+
+    /**
+     * @brief Switch the profiling of all the filters (see Filter::set_profiling),
+     * the filters can also be switched one by one.
+     */
+    void set_profiling(bool enable);
+
+    /**
+     * @brief Counters of each link (chunks, invalid, discontinuities & drops), by
+     * link name.
+     */
+    std::map<std::string, LinkInterface::Counters> link_counters() const;
 
     void print_stats();
 
@@ -79,13 +307,42 @@ public:
 
         // link
         auto link = std::make_unique<Link<T>>(src, src_pad_name, dst, dst_pad_name);
+        link->set_tracer(&tracer_);
         links_.push_back(std::move(link));
     }
 
 private:
+    FrameArena    frame_arena_;  /**< outlives the filters */
+    trace::Tracer tracer_;       /**< outlives the links */
+    std::map<const Filter*, uint32_t> filter_tracks_;
     std::map<std::string, std::unique_ptr<Filter>> filters_;
     std::vector<std::unique_ptr<LinkInterface>>    links_;
 
+    arma::uword batch_size_ = 1;
+    bool        huge_pages_ = false;
+    PageFaults  faults_base_ {};
+
+    std::atomic<std::size_t> budget_ {0};
+    MemoryPolicy             policy_ = MemoryPolicy::backpressure;
+    std::atomic<std::size_t> peak_memory_ {0};
+    std::atomic<bool>        over_budget_ {false};
+    std::atomic<arma::uword> n_throttled_ {0};
+    Scheduling  scheduling_ = Scheduling::demand;
+    std::atomic<arma::uword> n_forwarded_ {0}; /**< requests forwarded upstream */
+    std::atomic<arma::uword> n_deferred_ {0};  /**< pools left to reallocate */
+    std::shared_mutex exec_mutex_;  /**< shared during activations */
+    std::atomic<bool> paused_ {false};
+
+    struct Domain
+    {
+        std::vector<int> cpus;
+        std::thread      thread;
+    };
+    std::map<std::string, Domain>        domains_;
+    std::map<const Filter*, std::string> assignment_; /**< filter -> domain */
+    std::atomic<bool>                    running_ {false};
+    std::string negotiation_error_;
+
     std::condition_variable cv_;
     std::mutex              mutex_;
 
@@ -94,11 +351,11 @@ private:
      * @{ */
     struct
     {
-        arma::uword n_execs;
-        std::deque<std::chrono::duration<double>> durations;
+        arma::uword    n_execs;
+        perf::Counters counters;
     } stats_;
 
-    void update_stats(std::chrono::duration<double>& duration);
+    void update_stats(const perf::Counters& c, arma::uword n);
     void reset_stats();
 
     arma::uword n_execs() const {return stats_.n_execs;}
@@ -107,13 +364,68 @@ private:
 
 
     /**
-     * Browse filters in the pipeline looking for filters ready to activate.
-     * Returns after the activation of a filter or after browsing all filters.
+     * Browse the filters of a domain looking for filters ready to activate, then for
+     * wanted filters. Returns after the activation of a filter or the forwarding of
+     * a request, or after browsing all filters.
+     *
+     * @param domain Domain of the filters ("" for the calling thread)
      *
-     * @return 1 if a filter was activated
+     * @return 1 if a filter was activated (or a request forwarded)
      *         0 if no filter was activated
      */
-    int run_once();
+    int run_once(const std::string& domain = "");
+
+    /**
+     * Activate a filter (repeated up to the batch size while it has something to do)
+     */
+    void activate(Filter * f);
+
+    /**
+     * Forward the request of a wanted filter to the sources of its inputs if none of
+     * them has anything to offer.
+     *
+     * @return false if the filter must be activated instead (source, data or eof
+     *         available on an input)
+     */
+    bool forward_request(Filter * f);
+
+    /**
+     * Update the memory high-water mark & apply the policy if over the budget
+     * (called by the domain of the activated filter)
+     */
+    void check_budget(const std::string& domain);
+
+    /**
+     * true if the source must wait for the rest of the pipeline to drain (another
+     * filter is ready or wanted & has a chunk or eof on an input). Doesn't lock the
+     * link queues, so that it can be called with mutex_ held.
+     */
+    bool throttled(const Filter * f) const;
+
+    /**
+     * Domain of a filter ("" if it's not assigned)
+     */
+    const std::string& domain(const Filter * f) const;
+
+    /**
+     * true if a filter of the domain is ready or wanted (called with mutex_ held)
+     */
+    bool domain_ready(const std::string& domain) const;
+
+    /**
+     * Body of the domain threads
+     */
+    void run_domain(const std::string& name);
+
+    /**
+     * Filters in topological order (sources first)
+     */
+    std::vector<Filter*> sorted_filters() const;
+
+    /**
+     * Negotiate the given filters (in topological order) & their input links
+     */
+    Contract negotiate(const std::vector<Filter*>& filters, bool propagate = true);
 };
 
 } /* namespace dsp */
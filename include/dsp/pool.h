@@ -0,0 +1,158 @@
+#pragma once
+
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include <armadillo>
+
+#include "chunk_header.h"
+#include "format.h"
+#include "pages.h"
+
+namespace dsp {
+
+template<typename T>
+struct Chunk;
+
+/**
+ * @brief Pool of chunks of a given format.
+ *
+ * Chunks are handed out as shared pointers whose deleter gives them back to the
+ * pool once the last owner releases them, so that the payload is only allocated
+ * once. The free list is protected by a mutex since chunks may be released from
+ * another thread than the one that acquired them (e.g. by a source filter).
+ *
+ * The pool state is shared with the deleters: a chunk released after the pool has
+ * been destroyed (or after a format change) is simply freed.
+ *
+ * @tparam T Chunk data type
+ */
+template<typename T>
+class ChunkPool
+{
+public:
+    using pointer = std::shared_ptr<Chunk<T>>;
+
+    ChunkPool(): state_(std::make_shared<State>()) {}
+
+    /**
+     * @brief Set the format of the chunks & preallocate some of them.
+     *
+     * The chunks of the previous format are freed. The preallocated chunks are
+     * written once so that their pages are mapped by the calling thread, i.e. on its
+     * NUMA node (first-touch policy).
+     *
+     * With huge_pages, the chunks of at least HugePages::huge_page_size bytes are
+     * stored in huge pages, prefaulted when they're allocated (see HugePages).
+     */
+    void set_format(const Format& fmt, arma::uword n_prealloc = 0, bool huge_pages = false)
+    {
+        std::unique_lock<std::mutex> lk(state_->mutex);
+        state_->fmt  = fmt;
+        state_->huge = huge_pages &&
+            fmt.n_rows * fmt.n_cols * fmt.n_slices * sizeof(T) >= HugePages::huge_page_size;
+        state_->free.clear();
+        state_->n_allocated = 0;
+        for (arma::uword i = 0; i < n_prealloc; ++i) {
+            auto chunk = allocate(fmt, state_->huge);
+            if (!state_->huge)
+                chunk->zeros();
+            state_->free.push_back(std::move(chunk));
+            state_->n_allocated++;
+        }
+    }
+
+    /**
+     * @brief Get a chunk from the pool (allocated if the pool is empty).
+     *
+     * NB: the content of the chunk is undefined
+     */
+    pointer acquire(const ChunkHeader& header)
+    {
+        std::unique_ptr<Chunk<T>> chunk;
+        Format fmt;
+        bool   huge;
+        {
+            std::unique_lock<std::mutex> lk(state_->mutex);
+            fmt  = state_->fmt;
+            huge = state_->huge;
+            if (!state_->free.empty()) {
+                chunk = std::move(state_->free.back());
+                state_->free.pop_back();
+            } else {
+                state_->n_allocated++;
+            }
+        }
+
+        if (!chunk)
+            chunk = allocate(fmt, huge);
+
+        chunk->header = header;
+        return pointer(chunk.release(), Recycler{state_, fmt});
+    }
+
+    const Format& format() const {return state_->fmt;}
+
+    /**
+     * @brief true if the chunks are stored in huge pages.
+     */
+    bool huge_pages() const
+    {
+        std::unique_lock<std::mutex> lk(state_->mutex);
+        return state_->huge;
+    }
+
+    arma::uword n_allocated() const
+    {
+        std::unique_lock<std::mutex> lk(state_->mutex);
+        return state_->n_allocated;
+    }
+
+    arma::uword n_free() const
+    {
+        std::unique_lock<std::mutex> lk(state_->mutex);
+        return state_->free.size();
+    }
+
+private:
+    struct State
+    {
+        std::mutex  mutex;
+        Format      fmt;
+        bool        huge        = false;
+        arma::uword n_allocated = 0;
+        std::vector<std::unique_ptr<Chunk<T>>> free;
+    };
+
+    struct Recycler
+    {
+        std::weak_ptr<State> state;
+        Format               fmt;
+
+        void operator()(Chunk<T> * p) const
+        {
+            std::unique_ptr<Chunk<T>> chunk(p);
+            auto s = state.lock();
+            if (!s)
+                return;
+            std::unique_lock<std::mutex> lk(s->mutex);
+            if (s->fmt == fmt)
+                s->free.push_back(std::move(chunk));
+        }
+    };
+
+    std::shared_ptr<State> state_;
+
+    static
+    std::unique_ptr<Chunk<T>> allocate(const Format& fmt, bool huge)
+    {
+        if (huge) {
+            HugePages mem(fmt.n_rows * fmt.n_cols * fmt.n_slices * sizeof(T), true);
+            return std::make_unique<Chunk<T>>(ChunkHeader(), fmt, std::move(mem));
+        }
+        return std::make_unique<Chunk<T>>(ChunkHeader(), fmt);
+    }
+};
+
+} /* namespace dsp */
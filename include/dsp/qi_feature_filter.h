@@ -1,106 +1,258 @@
 #pragma once
 
-#include <deque>
+#include <cmath>
+#include <complex>
+#include <memory>
 
 #include "common/log.h"
+#include "sigpack.h"
+#include "fftw.h"
 #include "filter.h"
+#include "join_filter.h"
 #include "link.h"
 
 namespace dsp::filter {
 
+/**
+ * @brief Features available for the quality index (bit mask).
+ *
+ * The features are written in the output chunk in the order of this enum (the
+ * correlation coefficient is always the last row).
+ */
+namespace qi_feature {
+enum : unsigned {
+    stddev             = 1 << 0, /**< standard deviation of the IQ signal */
+    power              = 1 << 1, /**< mean power |x|^2 */
+    mean               = 1 << 2, /**< magnitude of the mean */
+    variance           = 1 << 3, /**< variance of the IQ signal */
+    kurtosis           = 1 << 4, /**< kurtosis of the envelope |x| */
+    spectral_entropy   = 1 << 5, /**< normalized entropy of the periodogram */
+    zero_crossing_rate = 1 << 6, /**< sign changes of the in-phase component per sample */
+    clipping_ratio     = 1 << 7, /**< ratio of samples with |I| or |Q| >= clip level */
+    last               = 1 << 8,
+};
+} /* namespace qi_feature */
+
 /**
  * @brief Builds the feature matrice for the quality index
  *
+ * All the moments are computed from sums shifted by the first sample, which don't
+ * suffer from the cancellation of raw sums. The channel is split into its real &
+ * imaginary parts & the sums are `omp simd` reductions over them (vectorized with
+ * -O3). Only the spectral entropy needs another pass (FFT).
+ *
+ * The iq & cor chunks are matched by timestamp (see Join), unmatched chunks are
+ * dropped (or throw with LatePolicy::fail). LatePolicy::partial isn't supported: the
+ * features need both chunks.
+ *
+ * NB: fmt_out.n_rows must be equal to the number of enabled features + 1 (format
+ * negotiation will fail otherwise)
+ *
  * @tparam T1 IQ chunk type
  * @tparam T2 correlation coefficient type
  * @tparam T3 feature matrix type
  */
 template<typename T1, typename T2, typename T3 = double>
-class QIFeatureFilter: public Filter
+class QIFeatureFilter: public Join<T1, T2>
 {
+    using Base = Join<T1, T2>;
+    using Base::input_pads_;
+    using Base::output_pads_;
+    using Base::outputs_;
+
 public:
-    QIFeatureFilter(common::Logger logger, std::string_view name = "qi_feat_extractor"):
-        Filter(logger, name)
+    /**
+     * @param features Bit mask of qi_feature
+     * @param clip_level Clipping level of the I & Q components
+     * @param tolerance Maximum difference between the iq & cor timestamps in ns
+     * @param policy Handling of the unmatched chunks (drop or fail)
+     */
+    QIFeatureFilter(common::Logger logger, std::string_view name = "qi_feat_extractor",
+                    unsigned features = qi_feature::stddev, double clip_level = 32767,
+                    int64_t tolerance = 0, LatePolicy policy = LatePolicy::drop):
+        Base(logger, name, {"iq", "cor"}, tolerance, 16, policy),
+        features_(features), clip_level_(clip_level)
     {
-        Pad iq  {.name = "iq" , .format = Format()};
-        Pad cor {.name = "cor", .format = Format()};
         Pad out {.name = "out", .format = Format()};
-        input_pads_.insert({iq.name, iq});
-        input_pads_.insert({cor.name, cor});
         output_pads_.insert({out.name, out});
+
+        if (features_ == 0 || features_ >= qi_feature::last)
+            throw dsp_error(Errc::invalid_parameters);
+        if (policy == LatePolicy::partial)
+            throw dsp_error(Errc::invalid_parameters, "partial sets are not supported");
     }
 
-    int activate() override
+    void propagate_format() override
     {
-        log_debug(logger_, "{} filter activated", name_);
+        auto fmt = input_pads_["iq"].format;
+        this->derive_output_format({n_features() + 1, fmt.n_cols, fmt.n_slices}, "out");
+    }
 
-        auto input_iq  = dynamic_cast<Link<T1>*>(inputs_.at("iq"));
-        auto input_cor = dynamic_cast<Link<T2>*>(inputs_.at("cor"));
-        auto output    = dynamic_cast<Link<T3>*>(outputs_.at("out"));
+    Contract negotiate_format() override
+    {
+        if (!this->time_major_pads())
+            return Contract::unsupported_format;
 
-        if (!iq_received_ && !input_iq->pop(chunk_iq_)) {
-            if (input_iq->eof())
-                output->eof_reached();
-            return 0;
+        auto fmt_iq  = input_pads_["iq"].format;
+        auto fmt_cor = input_pads_["cor"].format;
+        auto fmt_out = output_pads_["out"].format;
+
+        if ((fmt_iq.n_cols   != fmt_cor.n_cols)   || (fmt_iq.n_cols   != fmt_out.n_cols) ||
+            (fmt_iq.n_slices != fmt_cor.n_slices) || (fmt_iq.n_slices != fmt_out.n_slices) ||
+            (fmt_cor.n_rows  != 1) || (fmt_out.n_rows != n_features() + 1) ||
+            (fmt_iq.n_rows   <  2)) {
+            return Contract::unsupported_format;
         }
-        iq_received_ = true;
 
-        // we have the iq waveform, wait for the corcoeff
-        if (!cor_received_ && !input_cor->pop(chunk_cor_)) {
-            if (input_cor->eof())
-                output->eof_reached();
-            return 0;
+        // Create fftw plan by first application of fft
+        if (features_ & qi_feature::spectral_entropy) {
+            fftw_ = std::make_unique<fftw::FFT>(fmt_iq.n_rows, FFTW_MEASURE);
+            spectrum_in_.zeros(fmt_iq.n_rows);
+            spectrum_out_.zeros(fmt_iq.n_rows);
+            fftw_->fft_cx(spectrum_in_, spectrum_out_);
         }
-        cor_received_ = true;
 
-        // if one input is missing, wait...
-        if (!iq_received_ || !cor_received_)
-            return 0;
+        return Contract::supported_format;
+    }
+
+    /**
+     * @brief Number of enabled features (the correlation coefficient excluded)
+     */
+    arma::uword n_features() const {return __builtin_popcount(features_);}
+
+protected:
+    void process(const typename Base::Chunks& chunks) override
+    {
+        auto& [chunk_iq, chunk_cor] = chunks;
+        auto output = dynamic_cast<Link<T3>*>(outputs_.at("out"));
 
-        iq_received_  = false;
-        cor_received_ = false;
         const auto fmt_out = output->format();
-        auto chunk_out = std::make_shared<Chunk<T3>>(chunk_iq_->timestamp, chunk_iq_->sample_period,
-                                                     fmt_out);
+        const arma::uword n_rows = chunk_iq->n_rows;
+        auto chunk_out = output->make_chunk(chunk_iq->header);
+        chunk_out->header.merge(chunk_cor->header);
 
-        // computes the power
         for (arma::uword k = 0; k < fmt_out.n_slices; ++k) {
-            chunk_out->slice(k).row(0) = arma::stddev(chunk_iq_->slice(k));
+            for (arma::uword j = 0; j < fmt_out.n_cols; ++j) {
+                T3 * out = chunk_out->slice_colptr(k, j);
+                compute_features(chunk_iq->slice_colptr(k, j), n_rows, out);
+                // add the correlation as the last feature
+                out[fmt_out.n_rows - 1] = (*chunk_cor)(0, j, k);
+            }
         }
 
-        // add the correlation as the last feature
-        chunk_out->row(1) = chunk_cor_->row(0);
-
         output->push(chunk_out);
-        return 1;
     }
 
-    void reset() override
+private:
+    unsigned features_;
+    double   clip_level_;
+
+    std::unique_ptr<fftw::FFT> fftw_;
+    arma::cx_vec spectrum_in_;
+    arma::cx_vec spectrum_out_;
+    arma::vec    re_;
+    arma::vec    im_;
+
+    void compute_features(const T1 * x, arma::uword n, T3 * out)
     {
-        /* TODO: todo <24-03-21, cneyton> */
+        using R = double;
+
+        // split the real & imaginary parts: the reductions below don't vectorize on
+        // std::complex (nor with std::abs)
+        re_.set_size(n);
+        im_.set_size(n);
+        R * re = re_.memptr();
+        R * im = im_.memptr();
+        for (arma::uword i = 0; i < n; ++i) {
+            re[i] = std::real(x[i]);
+            im[i] = std::imag(x[i]);
+        }
+
+        const R r0 = re[0], i0 = im[0];
+        const R a0 = std::sqrt(r0 * r0 + i0 * i0);
+
+        // shifted sums of the signal & of its envelope
+        R s1r = 0, s1i = 0, s2 = 0, p = 0;
+        R e1 = 0, e2 = 0, e3 = 0, e4 = 0;
+        R n_clip = 0, n_cross = 0;
+        const R clip = clip_level_;
+#pragma omp simd reduction(+: s1r, s1i, s2, p, e1, e2, e3, e4, n_clip)
+        for (arma::uword i = 0; i < n; ++i) {
+            const R dr = re[i] - r0;
+            const R di = im[i] - i0;
+            s1r += dr;
+            s1i += di;
+            s2  += dr * dr + di * di;
+
+            const R pi = re[i] * re[i] + im[i] * im[i];
+            p += pi;
+
+            const R a  = std::sqrt(pi) - a0;
+            const R a2 = a * a;
+            e1 += a;
+            e2 += a2;
+            e3 += a2 * a;
+            e4 += a2 * a2;
+
+            n_clip += (std::abs(re[i]) >= clip) | (std::abs(im[i]) >= clip);
+        }
+#pragma omp simd reduction(+: n_cross)
+        for (arma::uword i = 1; i < n; ++i)
+            n_cross += (re[i] < 0) != (re[i - 1] < 0);
+
+        // unbiased estimates, a single sample has no spread nor crossing
+        const R nn       = static_cast<R>(n);
+        const R n1       = n > 1 ? nn - 1 : 1;
+        const R variance = n > 1 ? (s2 - (s1r * s1r + s1i * s1i) / nn) / n1 : 0;
+
+        arma::uword r = 0;
+        if (features_ & qi_feature::stddev)
+            out[r++] = std::sqrt(variance);
+        if (features_ & qi_feature::power)
+            out[r++] = p / nn;
+        if (features_ & qi_feature::mean)
+            out[r++] = std::hypot(r0 + s1r / nn, i0 + s1i / nn);
+        if (features_ & qi_feature::variance)
+            out[r++] = variance;
+        if (features_ & qi_feature::kurtosis) {
+            // central moments of the envelope from the shifted sums
+            const R m1 = e1 / nn, m2 = e2 / nn, m3 = e3 / nn, m4 = e4 / nn;
+            const R c2 = m2 - m1 * m1;
+            const R c4 = m4 - 4 * m1 * m3 + 6 * m1 * m1 * m2 - 3 * m1 * m1 * m1 * m1;
+            out[r++] = c2 > 0 ? c4 / (c2 * c2) : 0;
+        }
+        if (features_ & qi_feature::spectral_entropy)
+            out[r++] = spectral_entropy(x, n);
+        if (features_ & qi_feature::zero_crossing_rate)
+            out[r++] = n_cross / n1;
+        if (features_ & qi_feature::clipping_ratio)
+            out[r++] = n_clip / nn;
     }
 
-    Contract negotiate_format() override
+    double spectral_entropy(const T1 * x, arma::uword n)
     {
-        auto fmt_iq  = input_pads_["iq"].format;
-        auto fmt_cor = input_pads_["cor"].format;
-        auto fmt_out = output_pads_["out"].format;
+        if (n < 2)
+            return 0;
 
-        if ((fmt_iq.n_cols   != fmt_cor.n_cols)   || (fmt_iq.n_cols   != fmt_out.n_cols) ||
-            (fmt_iq.n_slices != fmt_cor.n_slices) || (fmt_iq.n_slices != fmt_out.n_slices) ||
-            (fmt_cor.n_rows  != 1) || (fmt_out.n_rows != 2)) {
-            return Contract::unsupported_format;
+        for (arma::uword i = 0; i < n; ++i)
+            spectrum_in_[i] = arma::cx_double(x[i]);
+        fftw_->fft_cx(spectrum_in_, spectrum_out_);
+
+        // with q = p / total: -sum(q log q) = log(total) - sum(p log p) / total
+        const arma::cx_double * X = spectrum_out_.memptr();
+        double total = 0, plogp = 0;
+        for (arma::uword i = 0; i < n; ++i) {
+            const double p = std::norm(X[i]);
+            total += p;
+            if (p > 0)
+                plogp += p * std::log(p);
         }
+        if (total <= 0)
+            return 0;
 
-        return Contract::supported_format;
+        const double h = std::log(total) - plogp / total;
+        return h / std::log(static_cast<double>(n));
     }
-
-private:
-    // we can use a map here if there is more input
-    bool cor_received_ = false;
-    bool iq_received_  = false;
-    std::shared_ptr<Chunk<T1>> chunk_iq_;
-    std::shared_ptr<Chunk<T2>> chunk_cor_;
 };
 
 } /* namespace dsp::filter */
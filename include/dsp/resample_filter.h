@@ -0,0 +1,175 @@
+#pragma once
+
+#include <algorithm>
+#include <numeric>
+
+#include "sigpack.h"
+#include "filter.h"
+#include "link.h"
+
+namespace dsp::filter {
+
+/**
+ * @brief Rational L/M sample-rate conversion.
+ *
+ * Polyphase implementation of sp::resampling::upfirdown: the upsampling zeros are
+ * never multiplied and only the kept outputs are computed. The history of each
+ * channel is kept between chunks and the phase of every output is computed once
+ * during the format negotiation.
+ *
+ * NB: fmt_out.n_rows * M must be equal to fmt_in.n_rows * L (format negotiation
+ * will fail otherwise)
+ *
+ * @tparam T1 Data type
+ * @tparam T2 Taps type
+ */
+template<typename T1, typename T2 = double>
+class Resample: public Filter
+{
+public:
+    /**
+     * @param up Upsampling factor L
+     * @param down Downsampling factor M
+     * @param taps Anti-alias FIR taps at the upsampled rate (default sp::fir1 design
+     *             with 8*max(L,M)+1 taps & a cutoff of 1/max(L,M) if empty)
+     */
+    Resample(common::Logger logger, std::string_view name, arma::uword up, arma::uword down,
+             const arma::Col<T2>& taps = arma::Col<T2>()):
+        Filter(logger, name)
+    {
+        Pad in  {.name = "in" , .format = Format()};
+        Pad out {.name = "out", .format = Format()};
+        input_pads_.insert({in.name, in});
+        output_pads_.insert({out.name, out});
+
+        if (up == 0 || down == 0)
+            throw dsp_error(Errc::invalid_parameters);
+
+        arma::uword g = std::gcd(up, down);
+        up_   = up / g;
+        down_ = down / g;
+
+        arma::Col<T2> h = taps;
+        if (h.is_empty()) {
+            arma::uword m = std::max(up_, down_);
+            h = arma::conv_to<arma::Col<T2>>::from(sp::fir1(8 * m, 1.0 / m));
+        }
+
+        // split the taps in L reversed sub-filters with the upsampling gain folded in
+        n_taps_ = (h.n_elem + up_ - 1) / up_;
+        sub_taps_.zeros(n_taps_, up_);
+        for (arma::uword k = 0; k < h.n_elem; ++k)
+            sub_taps_(n_taps_ - 1 - k / up_, k % up_) = static_cast<T2>(up_) * h(k);
+    }
+
+    Resample(common::Logger logger, arma::uword up, arma::uword down,
+             const arma::Col<T2>& taps = arma::Col<T2>()):
+        Resample(logger, "resample", up, down, taps)
+    {
+    }
+
+    int activate() override
+    {
+        log_debug(logger_, "{} filter activated", name_);
+
+        auto input    = dynamic_cast<Link<T1>*>(inputs_.at("in"));
+        auto output   = dynamic_cast<Link<T1>*>(outputs_.at("out"));
+        typename Link<T1>::const_elem_type chunk_in;
+
+        if (!input->pop(chunk_in)) {
+            if (input->eof())
+                output->eof_reached();
+            return 0;
+        }
+
+        const auto fmt_in  = input->format();
+        const auto fmt_out = output->format();
+
+        auto header = chunk_in->header;
+        header.sample_period = header.sample_period.scaled(down_, up_);
+        auto chunk_out = output->make_chunk(header);
+
+        const arma::uword history = n_taps_ - 1;
+        arma::uword n = 0;
+        for (arma::uword k = 0; k < fmt_in.n_slices; ++k) {
+            for (arma::uword j = 0; j < fmt_in.n_cols; ++j) {
+                T1 * w = work_.colptr(n);
+                arma::arrayops::copy(w + history, chunk_in->slice_colptr(k, j), fmt_in.n_rows);
+
+                T1 * out = chunk_out->slice_colptr(k, j);
+                for (arma::uword m = 0; m < fmt_out.n_rows; ++m) {
+                    const T2 * h = sub_taps_.colptr(phase_[m]);
+                    const T1 * x = w + index_[m];
+                    T1 acc = T1(0);
+                    for (arma::uword i = 0; i < n_taps_; ++i)
+                        acc += h[i] * x[i];
+                    out[m] = acc;
+                }
+
+                // keep the last samples as history for the next chunk
+                std::copy(w + fmt_in.n_rows, w + fmt_in.n_rows + history, w);
+                n++;
+            }
+        }
+
+        if (verbose_) {
+            chunk_in->print();
+            chunk_out->print();
+        }
+
+        output->push(chunk_out);
+        return 1;
+    }
+
+    void reset() override
+    {
+        work_.zeros();
+    }
+
+    void propagate_format() override
+    {
+        auto fmt = input_pads_["in"].format;
+        derive_output_format({fmt.n_rows * up_ / down_, fmt.n_cols, fmt.n_slices}, "out");
+    }
+
+    Contract negotiate_format() override
+    {
+        if (!time_major_pads())
+            return Contract::unsupported_format;
+
+        auto fmt_in  = input_pads_["in"].format;
+        auto fmt_out = output_pads_["out"].format;
+
+        if (fmt_in.n_cols   != fmt_out.n_cols ||
+            fmt_in.n_slices != fmt_out.n_slices ||
+            fmt_out.n_rows * down_ != fmt_in.n_rows * up_) {
+            return Contract::unsupported_format;
+        }
+
+        // the phase pattern repeats every chunk since the ratio is exact
+        phase_.set_size(fmt_out.n_rows);
+        index_.set_size(fmt_out.n_rows);
+        for (arma::uword m = 0; m < fmt_out.n_rows; ++m) {
+            phase_[m] = (m * down_) % up_;
+            index_[m] = (m * down_) / up_;
+        }
+
+        work_.zeros(n_taps_ - 1 + fmt_in.n_rows, fmt_in.n_cols * fmt_in.n_slices);
+
+        return Contract::supported_format;
+    }
+
+    arma::uword up()   const {return up_;}
+    arma::uword down() const {return down_;}
+
+private:
+    arma::uword   up_;
+    arma::uword   down_;
+    arma::uword   n_taps_;   /**< number of taps per sub-filter */
+    arma::Mat<T2> sub_taps_; /**< one reversed sub-filter per column */
+    arma::uvec    phase_;    /**< sub-filter used by each output */
+    arma::uvec    index_;    /**< first work sample used by each output */
+    arma::Mat<T1> work_;     /**< history + current chunk, one column per channel */
+};
+
+} /* namespace dsp::filter */
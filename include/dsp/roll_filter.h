@@ -18,6 +18,9 @@ namespace dsp::filter {
  * NB: fmt_out.n_rows must be a multiple of fmt_out.n_rows (format negotiation
  * will fail otherwise)
  *
+ * An output never spans a gap: the queue is flushed at a discontinuity and the
+ * invalid input chunks are dropped, the next output is flagged as discontinuous.
+ *
  * @tparam T chunk type
  */
 template<typename T>
@@ -44,7 +47,7 @@ public:
 
         auto input    = dynamic_cast<Link<T>*>(inputs_.at("in"));
         auto output   = dynamic_cast<Link<T>*>(outputs_.at("out"));
-        auto chunk_in = std::make_shared<Chunk<T>>();
+        typename Link<T>::const_elem_type chunk_in;
 
         if (!input->pop(chunk_in)) {
             if (input->eof())
@@ -52,6 +55,14 @@ public:
             return 0;
         }
 
+        if (chunk_in->header.has(chunk_flag::discontinuity | chunk_flag::invalid)) {
+            flush(input);
+            if (chunk_in->header.has(chunk_flag::invalid)) {
+                input->count_dropped();
+                return 0;
+            }
+        }
+
         chunk_queue_.push_back(chunk_in);
         i_++;
 
@@ -67,11 +78,14 @@ public:
             return 0;
         }
 
-        auto chunk_out = std::make_shared<Chunk<T>>(chunk_queue_.front()->timestamp,
-                                                    chunk_queue_.front()->sample_period,
-                                                    fmt_out);
+        auto chunk_out = output->make_chunk(chunk_queue_.front()->header);
         for (arma::uword i = 0; i < queue_size_; ++i) {
             chunk_out->rows(i * fmt_in.n_rows, (i+1) * fmt_in.n_rows - 1) = *(chunk_queue_[i]);
+            chunk_out->header.merge(chunk_queue_[i]->header);
+        }
+        if (discontinuity_) {
+            chunk_out->header.flags |= chunk_flag::discontinuity;
+            discontinuity_ = false;
         }
         chunk_queue_.pop_front();
         output->push(chunk_out);
@@ -82,10 +96,21 @@ public:
     {
         i_ = 0;
         chunk_queue_.clear();
+        discontinuity_ = false;
+    }
+
+    void propagate_format() override
+    {
+        // the output size is free, only the channels are derived
+        auto fmt = input_pads_["in"].format;
+        derive_output_format({0, fmt.n_cols, fmt.n_slices}, "out");
     }
 
     Contract negotiate_format() override
     {
+        if (!time_major_pads())
+            return Contract::unsupported_format;
+
         auto fmt_in  = input_pads_["in"].format;
         auto fmt_out = output_pads_["out"].format;
 
@@ -100,11 +125,42 @@ public:
         return Contract::supported_format;
     }
 
+    arma::uword retained_chunks(const std::string&) const override {return queue_size_;}
+
+    std::size_t memory_usage() const override
+    {
+        return chunk_queue_.empty() ? 0 :
+            chunk_queue_.size() * chunk_queue_.front()->n_elem * sizeof(T);
+    }
+
+    /**
+     * @brief Change the number of input chunks between two outputs (see
+     * Pipeline::reconfigure).
+     */
+    void set_skip(arma::uword skip)
+    {
+        if (skip == 0)
+            throw dsp_error(Errc::invalid_parameters);
+        skip_ = skip;
+    }
+
+    arma::uword skip() const {return skip_;}
+
 private:
     arma::uword skip_;
     arma::uword i_ = 0;
-    std::deque<std::shared_ptr<Chunk<T>>> chunk_queue_;
-    arma::uword queue_size_;
+    std::deque<typename Link<T>::const_elem_type> chunk_queue_;
+    arma::uword queue_size_ = 0;
+    bool discontinuity_ = false; /**< flag the next output */
+
+    void flush(LinkInterface * input)
+    {
+        log_debug(logger_, "{}: discontinuity, {} chunks flushed", name_, chunk_queue_.size());
+        input->count_dropped(chunk_queue_.size());
+        chunk_queue_.clear();
+        i_ = 0;
+        discontinuity_ = true;
+    }
 };
 
 } /* namespace dsp::filter */
@@ -22,7 +22,7 @@ public:
 
         auto input = dynamic_cast<Link<T>*>(inputs_.at("in"));
 
-        auto chunk = std::make_shared<Chunk<T>>();
+        typename Link<T>::const_elem_type chunk;
         if (!input->pop(chunk))
             return 0;
 
@@ -38,6 +38,9 @@ public:
 
     Contract negotiate_format() override
     {
+        if (!time_major_pads())
+            return Contract::unsupported_format;
+
         return Contract::supported_format;
     }
 };
@@ -1,5 +1,8 @@
 #pragma once
 
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
 #include <mutex>
 #include <queue>
 
@@ -14,12 +17,26 @@ namespace dsp {
 
 struct SourceInterface
 {
+    /**
+     * @param timestamp Acquisition time of the frame in ms
+     */
     virtual void push_frame(std::string_view frame, uint32_t timestamp) = 0;
     virtual void eof() = 0;
 };
 
 namespace filter {
 
+/**
+ * @brief Source of the frames pushed by the acquisition (one frame = one time step
+ * of all the channels).
+ *
+ * With a channel_major output format the frames are written contiguously, the
+ * output link transposes the chunks if its destination expects time_major ones.
+ *
+ * The frames keep coming while the pipeline holds the source back (see
+ * Pipeline::MemoryPolicy): at most max_queue complete chunks wait to be pushed,
+ * the oldest one is dropped beyond that & the next one is flagged as discontinuous.
+ */
 template<typename T1, typename T2>
 class Source: public Filter, public SourceInterface
 {
@@ -63,6 +80,11 @@ public:
         while (!queue_.empty())
             queue_.pop();
         frame_nb_ = 0;
+        seq_      = 0;
+        n_invalid_frames_ = 0;
+        n_dropped_chunks_ = 0;
+        started_       = false;
+        resume_        = false;
         eof_ = false;
     }
 
@@ -76,16 +98,52 @@ public:
         const Format fmt = output_pads_["out"].format;
         size_t frame_size = expected_frame_size(fmt);
 
-        if (frame_nb_ == 0)
+        const int64_t ts = static_cast<int64_t>(timestamp) * 1000000;
+        // frame timestamps have a 1 ms resolution
+        const int64_t max_jitter = std::max<int64_t>(sample_period_.duration(1), 1000000);
+        const bool gap = started_ &&
+            std::abs(ts - (last_ts_ + sample_period_.duration(1))) > max_jitter;
+        if (gap)
+            log_warn(logger_, "{}: gap of {} ns before frame {}", name_,
+                     ts - last_ts_ - sample_period_.duration(1), frame_nb_);
+        started_ = true;
+        last_ts_ = ts;
+
+        // a chunk starting at the gap is only discontinuous
+        if (gap && frame_nb_ == 0)
+            resume_ = true;
+
+        if (frame_nb_ == 0) {
             // chunk_ will be overwritten if not null
-            chunk_ = std::make_unique<Chunk<T2>>(static_cast<arma::uword>(timestamp),
-                                                 sample_period_, fmt);
+            ChunkHeader header;
+            header.timestamp     = ts;
+            header.sample_period = sample_period_;
+            header.seq           = seq_++;
+            header.trace_id      = trace::next_id();
+            header.ingress_first = trace::now();
+            if (resume_) {
+                header.flags |= chunk_flag::discontinuity;
+                resume_ = false;
+            }
+            chunk_ = std::make_unique<Chunk<T2>>(header, fmt);
+        }
+
+        if (gap && frame_nb_ != 0) {
+            // the rows after the gap don't match the chunk timestamps: the chunk is
+            // invalid & the valid data resumes in the next one
+            chunk_->header.flags |= chunk_flag::invalid;
+            resume_ = true;
+        }
 
         if (frame.size() != frame_size) {
             log_warn(logger_, "frame size ({}) doesn't match expected size ({}), pushing invalid frame",
                                            frame.size(), frame_size);
             std::string invalid_frame(frame_size, 0);
             fill_frame(invalid_frame, frame_nb_);
+            chunk_->header.flags |= chunk_flag::invalid;
+            n_invalid_frames_++;
+            // the valid data resumes in the next chunk
+            resume_ = true;
         } else {
             fill_frame(frame, frame_nb_);
         }
@@ -93,8 +151,15 @@ public:
         if (++frame_nb_ < fmt.n_rows)
             return;
 
+        chunk_->header.ingress_last = trace::now();
+
         std::unique_lock<std::mutex> lk(mutex_);
         queue_.push(std::move(chunk_));
+        if (max_queue_ && queue_.size() > max_queue_) {
+            queue_.pop();
+            queue_.front()->header.flags |= chunk_flag::discontinuity;
+            n_dropped_chunks_++;
+        }
         frame_nb_ = 0;
         set_ready();
     }
@@ -106,15 +171,56 @@ public:
         set_ready();
     }
 
+    void set_sample_period(const Period& p) {sample_period_ = p;}
+    const Period& sample_period() const {return sample_period_;}
+
+    /**
+     * @brief Number of frames zero-filled because of their size (the chunks
+     * holding them are flagged chunk_flag::invalid).
+     */
+    arma::uword n_invalid_frames() const {return n_invalid_frames_;}
+
+    /**
+     * @brief Bound the complete chunks waiting to be pushed (0: no bound).
+     */
+    void set_max_queue(std::size_t n)
+    {
+        std::unique_lock<std::mutex> lk(mutex_);
+        max_queue_ = n;
+    }
+
+    /**
+     * @brief Number of chunks dropped because the queue was full.
+     */
+    arma::uword n_dropped_chunks() const {return n_dropped_chunks_;}
+
+    /**
+     * @brief The complete chunks waiting to be pushed (the one being filled isn't
+     * counted).
+     */
+    std::size_t memory_usage() const override
+    {
+        std::unique_lock<std::mutex> lk(mutex_);
+        return queue_.empty() ? 0 : queue_.size() * queue_.front()->n_elem * sizeof(T2);
+    }
+
 private:
-    arma::uword frame_nb_      = 0;
-    arma::uword sample_period_ = 1;
-    bool        eof_           = false;
+    arma::uword frame_nb_         = 0;
+    Period      sample_period_    = Period::ms(1);
+    uint64_t    seq_              = 0;
+    arma::uword n_invalid_frames_ = 0;
+    std::size_t max_queue_        = 64;
+    int64_t     last_ts_          = 0;     /**< timestamp of the last frame in ns */
+    bool        started_          = false;
+    bool        resume_           = false; /**< flag the next chunk as discontinuous */
+    bool        eof_              = false;
+
+    std::atomic<arma::uword> n_dropped_chunks_ {0};
 
     using elem_type = std::unique_ptr<Chunk<T2>>;
     elem_type             chunk_ = nullptr;
     std::queue<elem_type> queue_;
-    std::mutex            mutex_;
+    mutable std::mutex    mutex_;
 
     static
     size_t expected_frame_size(const Format& fmt) { return fmt.n_cols * fmt.n_slices * sizeof(T1); }
@@ -122,56 +228,38 @@ private:
     void   fill_frame(std::string_view buf, const arma::uword frame_nb);
 };
 
+namespace detail {
+
+template<typename T2, typename T1>
+inline T2 sample_cast(const T1& x) {return T2(x);}
+
+template<typename T2, typename T>
+inline T2 sample_cast(const IQ<T>& x) {return T2(x.i, x.q);}
+
+} /* namespace detail */
+
 template<typename T1, typename T2>
 inline
 void Source<T1, T2>::fill_frame(std::string_view buf, const arma::uword frame_nb)
 {
-    auto it = buf.cbegin();
-    arma::uword j = 0, k = 0;
-    arma::uword n = 0;
-    while(it != buf.cend()) {
-        auto x = reinterpret_cast<const T1*>(&*it);
-        it += sizeof(*x);
-        chunk_->at(frame_nb, j, k) = T2(*x);
-        n++;
-        j = n % chunk_->n_cols;
-        k = n / chunk_->n_cols;
-    }
-}
+    // buf holds the n_channels samples of each slice in a row (its size was checked)
+    auto x = reinterpret_cast<const T1*>(buf.data());
+    const arma::uword n_channels = chunk_->n_channels();
+    const arma::uword n_slices   = chunk_->n_slices;
 
-template<>
-inline
-void Source<IQ<int16_t>, arma::cx_double>::fill_frame(std::string_view buf,
-                                                      const arma::uword frame_nb)
-{
-    auto it = buf.cbegin();
-    arma::uword j = 0, k = 0;
-    arma::uword n = 0;
-    while(it != buf.cend()) {
-        auto x = reinterpret_cast<const IQ<int16_t>*>(&*it);
-        it += sizeof(*x);
-        chunk_->at(frame_nb, j, k) = arma::cx_double(x->i, x->q);
-        n++;
-        j = n % chunk_->n_cols;
-        k = n / chunk_->n_cols;
-    }
-}
-
-template<>
-inline
-void Source<IQ<int16_t>, arma::cx_float>::fill_frame(std::string_view buf,
-                                                     const arma::uword frame_nb)
-{
-    auto it = buf.cbegin();
-    arma::uword j = 0, k = 0;
-    arma::uword n = 0;
-    while(it != buf.cend()) {
-        auto x = reinterpret_cast<const IQ<int16_t>*>(&*it);
-        it += sizeof(*x);
-        chunk_->at(frame_nb, j, k) = arma::cx_float(x->i, x->q);
-        n++;
-        j = n % chunk_->n_cols;
-        k = n / chunk_->n_cols;
+    if (chunk_->layout == Layout::channel_major) {
+        // the frame is a contiguous row of each slice
+        for (arma::uword k = 0; k < n_slices; ++k) {
+            T2 * out = chunk_->slice_memptr(k) + frame_nb * n_channels;
+            for (arma::uword j = 0; j < n_channels; ++j)
+                out[j] = detail::sample_cast<T2>(x[k * n_channels + j]);
+        }
+    } else {
+        // one sample per column, the columns of the slices are consecutive
+        T2 * out = chunk_->memptr() + frame_nb;
+        const arma::uword stride = chunk_->n_rows;
+        for (arma::uword n = 0; n < n_channels * n_slices; ++n)
+            out[n * stride] = detail::sample_cast<T2>(x[n]);
     }
 }
 
@@ -5,6 +5,16 @@
 
 namespace dsp::filter {
 
+/**
+ * @brief Duplicate the input on N outputs.
+ *
+ * The same chunk is pushed on every output (no copy): consumers that want to modify
+ * it must call Link::make_writable, so that only the branches that actually write
+ * pay for a copy.
+ *
+ * @tparam T Chunk type
+ * @tparam N Number of outputs
+ */
 template<typename T, arma::uword N>
 class Tee: public Filter
 {
@@ -25,7 +35,7 @@ public:
     {
         log_debug(logger_, "filter {} activated", this->name_);
         auto input    = dynamic_cast<Link<T>*>(inputs_.at("in"));
-        auto chunk_in = std::make_shared<Chunk<T>>();
+        typename Link<T>::const_elem_type chunk_in;
 
         if (!input->pop(chunk_in)) {
             if (input->eof()) {
@@ -49,8 +59,17 @@ public:
         // nothing to do
     }
 
+    void propagate_format() override
+    {
+        for (arma::uword i = 0; i < N; ++i)
+            derive_output_format(input_pads_["in"].format, std::to_string(i));
+    }
+
     Contract negotiate_format() override
     {
+        if (!time_major_pads())
+            return Contract::unsupported_format;
+
         for (arma::uword i = 0; i < N; ++i) {
             if (input_pads_["in"].format != output_pads_[std::to_string(i)].format)
                 return Contract::unsupported_format;
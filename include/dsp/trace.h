@@ -0,0 +1,140 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace dsp::trace {
+
+/**
+ * @brief Monotonic time in ns, used for the ingress & trace timestamps.
+ */
+inline int64_t now()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/**
+ * @brief New trace id (unique in the process).
+ */
+uint64_t next_id();
+
+/**
+ * @brief Recorder of the per-hop timings of a pipeline.
+ *
+ * Each filter & each link has its own track:
+ * - the filters record the duration of their activations,
+ * - the links record the time spent by each chunk in their queue, and at each push
+ *   the latency since the arrival of the frames the chunk derives from.
+ *
+ * Recording is off by default, the hooks then only test a flag. The events are
+ * kept in memory (up to max_events, the next ones are dropped) & exported in the
+ * Chrome trace format, which Perfetto & chrome://tracing open.
+ *
+ * Each thread records in its own buffer, so that the domains don't contend on the
+ * tracer. The buffers are merged at export.
+ */
+class Tracer
+{
+public:
+    struct Latency
+    {
+        uint64_t n;
+        int64_t  mean; /**< ns */
+        int64_t  max;  /**< ns */
+    };
+
+    explicit Tracer(std::size_t max_events = 1 << 20);
+
+    void enable(bool on) {enabled_.store(on, std::memory_order_relaxed);}
+    bool enabled() const {return enabled_.load(std::memory_order_relaxed);}
+
+    /**
+     * @brief Id of the track with the given name (created if needed).
+     */
+    uint32_t track(const std::string& name);
+
+    /**
+     * @brief Activation of a filter that did something.
+     */
+    void activation(uint32_t track, int64_t start, int64_t end);
+
+    /**
+     * @brief Time spent by a chunk in a link queue.
+     */
+    void wait(uint32_t track, uint64_t trace_id, int64_t pushed, int64_t popped);
+
+    /**
+     * @brief Chunk pushed on a link, its ingress range is known.
+     */
+    void latency(uint32_t track, uint64_t trace_id, int64_t ingress_first,
+                 int64_t ingress_last, int64_t t);
+
+    /**
+     * @brief Latency since the arrival of the newest contributing frame, per link.
+     */
+    std::map<std::string, Latency> latencies() const;
+
+    /**
+     * @brief Write the recorded events in the Chrome trace (JSON) format.
+     */
+    void write_chrome_trace(const std::filesystem::path& filename) const;
+
+    void clear();
+
+    std::size_t n_events()  const {return n_events_;}
+    std::size_t n_dropped() const {return n_dropped_;}
+
+private:
+    enum class Kind: uint8_t {activation, wait, latency};
+
+    struct Event
+    {
+        Kind     kind;
+        uint32_t track;
+        uint64_t trace_id;
+        int64_t  ts;
+        int64_t  dur;  /**< activation & wait */
+        int64_t  lat;  /**< latency since the oldest frame */
+    };
+
+    struct Stats
+    {
+        uint64_t n   = 0;
+        int64_t  sum = 0;
+        int64_t  max = 0;
+    };
+
+    /** Events of one thread */
+    struct Buffer
+    {
+        std::mutex         mutex; /**< only contended by the export & clear */
+        std::vector<Event> events;
+        std::vector<Stats> stats; /**< latency per track */
+    };
+
+    const uint64_t           id_;  /**< key of the thread buffers */
+    std::atomic<bool>        enabled_ {false};
+    std::size_t              max_events_;
+    std::atomic<std::size_t> n_events_ {0};
+    std::atomic<std::size_t> n_dropped_ {0};
+
+    mutable std::mutex       mutex_; /**< tracks & list of buffers */
+    std::vector<std::string> tracks_;
+    std::vector<std::unique_ptr<Buffer>> buffers_;
+
+    /**
+     * @brief Buffer of the calling thread (created at its first event).
+     */
+    Buffer& buffer();
+    void record(const Event& e);
+};
+
+} /* namespace dsp::trace */
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <algorithm>
+
+#include <armadillo>
+
+namespace dsp::transpose {
+
+/**
+ * @brief Cache blocked out-of-place transpose of a column-major matrix.
+ *
+ * The matrix is processed by tiles small enough for the tile of the input & the one
+ * of the output to stay in L1, so that both are read & written a cache line at a
+ * time instead of one element per line on the strided side.
+ *
+ * @param in n_rows x n_cols matrix (column-major)
+ * @param out n_cols x n_rows matrix (column-major), must not overlap in
+ */
+template<typename T, arma::uword block = 32>
+void blocked(const T * in, arma::uword n_rows, arma::uword n_cols, T * out)
+{
+    for (arma::uword j0 = 0; j0 < n_cols; j0 += block) {
+        const arma::uword j1 = std::min(j0 + block, n_cols);
+        for (arma::uword i0 = 0; i0 < n_rows; i0 += block) {
+            const arma::uword i1 = std::min(i0 + block, n_rows);
+            for (arma::uword j = j0; j < j1; ++j) {
+                const T * src = in + j * n_rows;
+                for (arma::uword i = i0; i < i1; ++i)
+                    out[j + i * n_cols] = src[i];
+            }
+        }
+    }
+}
+
+/**
+ * @brief Transpose each slice of a cube (out must have the transposed dimensions).
+ */
+template<typename T>
+void slices(const arma::Cube<T>& in, arma::Cube<T>& out)
+{
+    for (arma::uword k = 0; k < in.n_slices; ++k)
+        blocked(in.slice_memptr(k), in.n_rows, in.n_cols, out.slice_memptr(k));
+}
+
+} /* namespace dsp::transpose */
@@ -0,0 +1,51 @@
+#include "dsp/arena.h"
+
+namespace dsp {
+
+FrameArena::FrameArena(std::size_t block_size):
+    block_size_(aligned(block_size)), offset_(block_size_)
+{
+}
+
+void * FrameArena::allocate(std::size_t n)
+{
+    n = aligned(n);
+    std::unique_lock<std::mutex> lk(mutex_);
+
+    auto search = free_.find(n);
+    if (search != free_.end() && !search->second.empty()) {
+        void * p = search->second.back();
+        search->second.pop_back();
+        return p;
+    }
+
+    if (n > block_size_) {
+        // dedicated block, inserted before the current one
+        auto block = std::make_unique<std::byte[]>(n);
+        void * p = block.get();
+        blocks_.insert(blocks_.empty() ? blocks_.end() : blocks_.end() - 1, std::move(block));
+        return p;
+    }
+
+    if (offset_ + n > block_size_) {
+        blocks_.push_back(std::make_unique<std::byte[]>(block_size_));
+        offset_ = 0;
+    }
+    void * p = blocks_.back().get() + offset_;
+    offset_ += n;
+    return p;
+}
+
+void FrameArena::deallocate(void * p, std::size_t n)
+{
+    std::unique_lock<std::mutex> lk(mutex_);
+    free_[aligned(n)].push_back(p);
+}
+
+std::size_t FrameArena::n_blocks() const
+{
+    std::unique_lock<std::mutex> lk(mutex_);
+    return blocks_.size();
+}
+
+} /* namespace dsp */
@@ -14,6 +14,9 @@ std::string ErrorCategory::message(int e) const
     case Errc::format_negotiation_failed: return "format negotation failed";
     case Errc::invalid_parameters:        return "invalid parameters";
     case Errc::duplicate_filter:          return "duplicate filter";
+    case Errc::invalid_model:             return "invalid model";
+    case Errc::misaligned_chunks:         return "misaligned chunks";
+    case Errc::invalid_graph:             return "invalid graph";
     default:                              return "unknown error code";
     }
 }
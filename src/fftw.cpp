@@ -0,0 +1,78 @@
+#include <fftw3.h>
+
+#include "dsp/fftw.h"
+#include "dsp/dsp_error.h"
+
+namespace dsp::fftw {
+
+std::recursive_mutex& planner_mutex()
+{
+    static std::recursive_mutex m;
+    return m;
+}
+
+namespace {
+
+unsigned long plans = 0; /**< guarded by planner_mutex */
+
+} /* namespace */
+
+unsigned long n_plans()
+{
+    std::unique_lock<std::recursive_mutex> lk(planner_mutex());
+    return plans;
+}
+
+bool import_wisdom(const std::filesystem::path& filename)
+{
+    std::unique_lock<std::recursive_mutex> lk(planner_mutex());
+    return fftw_import_wisdom_from_filename(filename.c_str()) != 0;
+}
+
+bool export_wisdom(const std::filesystem::path& filename)
+{
+    std::unique_lock<std::recursive_mutex> lk(planner_mutex());
+    return fftw_export_wisdom_to_filename(filename.c_str()) != 0;
+}
+
+FFT::~FFT()
+{
+    std::unique_lock<std::recursive_mutex> lk(planner_mutex());
+    if (fft_)
+        fftw_destroy_plan(fft_);
+    if (ifft_)
+        fftw_destroy_plan(ifft_);
+}
+
+fftw_plan FFT::plan(arma::cx_vec& in, arma::cx_vec& out, int sign)
+{
+    if (in.n_elem != n_ || out.n_elem != n_)
+        throw dsp_error(Errc::invalid_parameters, "fft of length " + std::to_string(n_));
+
+    std::unique_lock<std::recursive_mutex> lk(planner_mutex());
+    auto p = fftw_plan_dft_1d(static_cast<int>(n_), reinterpret_cast<fftw_complex*>(in.memptr()),
+                              reinterpret_cast<fftw_complex*>(out.memptr()), sign, flags_);
+    if (!p)
+        throw dsp_error(Errc::invalid_parameters, "unable to create the fftw plan");
+    plans++;
+    return p;
+}
+
+void FFT::fft_cx(arma::cx_vec& x, arma::cx_vec& spectrum)
+{
+    if (!fft_)
+        fft_ = plan(x, spectrum, FFTW_FORWARD);
+    fftw_execute_dft(fft_, reinterpret_cast<fftw_complex*>(x.memptr()),
+                     reinterpret_cast<fftw_complex*>(spectrum.memptr()));
+}
+
+void FFT::ifft_cx(arma::cx_vec& spectrum, arma::cx_vec& x)
+{
+    if (!ifft_)
+        ifft_ = plan(spectrum, x, FFTW_BACKWARD);
+    fftw_execute_dft(ifft_, reinterpret_cast<fftw_complex*>(spectrum.memptr()),
+                     reinterpret_cast<fftw_complex*>(x.memptr()));
+    x /= static_cast<double>(n_);
+}
+
+} /* namespace dsp::fftw */
@@ -30,14 +30,16 @@ void Filter::set_input_format(const Format& f, const std::string& pad_name)
 {
     if (input_pads_.find(pad_name) == input_pads_.end())
         throw dsp_error(Errc::pad_unknown);
-    input_pads_[pad_name].format = f;
+    input_pads_[pad_name].format    = f;
+    input_pads_[pad_name].requested = f;
 }
 
 void Filter::set_output_format(const Format& f, const std::string& pad_name)
 {
     if (output_pads_.find(pad_name) == output_pads_.end())
         throw dsp_error(Errc::pad_unknown);
-    output_pads_[pad_name].format = f;
+    output_pads_[pad_name].format    = f;
+    output_pads_[pad_name].requested = f;
 }
 
 const Format& Filter::get_input_format(const std::string& pad_name)
@@ -54,16 +56,72 @@ const Format& Filter::get_output_format(const std::string& pad_name)
     return output_pads_[pad_name].format;
 }
 
-void Filter::update_stats(std::chrono::duration<double>& duration)
+namespace {
+
+// fields of the requested format left to 0 are taken from f, the layout is the
+// one of the pad (a mismatch is handled by the link)
+Format derive(const Format& requested, const Format& f)
+{
+    return {requested.n_rows   ? requested.n_rows   : f.n_rows,
+            requested.n_cols   ? requested.n_cols   : f.n_cols,
+            requested.n_slices ? requested.n_slices : f.n_slices,
+            requested.layout};
+}
+
+} /* namespace */
+
+void Filter::derive_input_format(const Format& f, const std::string& pad_name)
+{
+    if (input_pads_.find(pad_name) == input_pads_.end())
+        throw dsp_error(Errc::pad_unknown);
+    auto& pad  = input_pads_[pad_name];
+    pad.format = derive(pad.requested, f);
+}
+
+void Filter::derive_output_format(const Format& f, const std::string& pad_name)
+{
+    if (output_pads_.find(pad_name) == output_pads_.end())
+        throw dsp_error(Errc::pad_unknown);
+    auto& pad  = output_pads_[pad_name];
+    pad.format = derive(pad.requested, f);
+}
+
+bool Filter::time_major_pads() const
+{
+    for (auto& pads: {&input_pads_, &output_pads_})
+        for (auto& [name, pad]: *pads)
+            if (pad.format.layout != Layout::time_major)
+                return false;
+    return true;
+}
+
+void Filter::update_stats(const perf::Counters& c, arma::uword n)
 {
-    stats_.n_execs++;
-    stats_.durations.push_back(duration);
+    std::unique_lock<std::mutex> lk(stats_mutex_);
+    stats_.n_execs  += n;
+    stats_.counters += c;
 }
 
 void Filter::reset_stats()
 {
-    stats_.n_execs = 0;
-    stats_.durations.clear();
+    n_activations_ = 0;
+    n_idle_        = 0;
+    peak_memory_   = memory_.load();
+    std::unique_lock<std::mutex> lk(stats_mutex_);
+    stats_.n_execs  = 0;
+    stats_.counters = perf::Counters();
+}
+
+arma::uword Filter::n_execs() const
+{
+    std::unique_lock<std::mutex> lk(stats_mutex_);
+    return stats_.n_execs;
+}
+
+perf::Counters Filter::perf_counters() const
+{
+    std::unique_lock<std::mutex> lk(stats_mutex_);
+    return stats_.counters;
 }
 
 } /* namespace dsp */
@@ -0,0 +1,249 @@
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdlib>
+#include <limits>
+#include <map>
+#include <mutex>
+
+#include "dsp/forest.h"
+
+namespace dsp {
+
+namespace {
+
+constexpr char     magic[8] = {'D', 'S', 'P', 'F', 'O', 'R', 'S', 'T'};
+constexpr uint32_t version  = 1;
+
+// every table starts on an 8 bytes boundary
+size_t aligned(size_t n) {return (n + 7) & ~size_t(7);}
+
+struct Layout
+{
+    size_t roots, depths, feature, child, leaf, threshold, probs, size;
+
+    Layout(uint64_t n_trees, uint64_t n_nodes, uint64_t n_probs, size_t header)
+    {
+        roots     = aligned(header);
+        depths    = aligned(roots     + n_trees * sizeof(uint32_t));
+        feature   = aligned(depths    + n_trees * sizeof(uint32_t));
+        child     = aligned(feature   + n_nodes * sizeof(uint32_t));
+        leaf      = aligned(child     + n_nodes * sizeof(uint32_t));
+        threshold = aligned(leaf      + n_nodes * sizeof(uint32_t));
+        probs     = aligned(threshold + n_nodes * sizeof(double));
+        size      = aligned(probs     + n_probs * sizeof(double));
+    }
+};
+
+// mappings shared by all the forests of the process, the file identity tells if a
+// mapping is still the one of the file at that path
+struct Mapping
+{
+    std::weak_ptr<const void> storage;
+    dev_t dev;
+    ino_t ino;
+    off_t size;
+    struct timespec mtime;
+
+    bool same_file(const struct stat& st) const
+    {
+        return dev == st.st_dev && ino == st.st_ino && size == st.st_size &&
+               mtime.tv_sec == st.st_mtim.tv_sec && mtime.tv_nsec == st.st_mtim.tv_nsec;
+    }
+};
+
+std::mutex                      mappings_mutex;
+std::map<std::string, Mapping>  mappings;
+
+} /* namespace */
+
+FlatForest FlatForest::pack(const Tables& t)
+{
+    const uint64_t n_leaves = t.n_classes ? t.probs.size() / t.n_classes : 0;
+    Layout l(t.roots.size(), t.feature.size(), t.probs.size(), sizeof(Header));
+
+    // uint64_t storage for the alignment of the double tables
+    auto buf = std::shared_ptr<uint64_t[]>(new uint64_t[l.size / sizeof(uint64_t)]());
+    auto base = reinterpret_cast<char*>(buf.get());
+
+    Header h {};
+    std::memcpy(h.magic, magic, sizeof(magic));
+    h.version    = version;
+    h.n_classes  = t.n_classes;
+    h.n_features = t.n_features;
+    h.n_trees    = t.roots.size();
+    h.n_nodes    = t.feature.size();
+    h.n_leaves   = n_leaves;
+    h.size       = l.size;
+    std::memcpy(base, &h, sizeof(h));
+
+    auto copy = [base](size_t offset, const auto& v) {
+        std::memcpy(base + offset, v.data(), v.size() * sizeof(v[0]));
+    };
+    copy(l.roots,     t.roots);
+    copy(l.depths,    t.depths);
+    copy(l.feature,   t.feature);
+    copy(l.child,     t.child);
+    copy(l.leaf,      t.leaf);
+    copy(l.threshold, t.threshold);
+    copy(l.probs,     t.probs);
+
+    FlatForest f;
+    f.bind(std::shared_ptr<const void>(buf, base), l.size);
+    return f;
+}
+
+void FlatForest::bind(std::shared_ptr<const void> storage, size_t size)
+{
+    auto base = static_cast<const char*>(storage.get());
+    if (size < sizeof(Header))
+        throw dsp_error(Errc::invalid_model);
+
+    auto h = reinterpret_cast<const Header*>(base);
+    if (std::memcmp(h->magic, magic, sizeof(magic)) != 0 || h->version != version ||
+        h->size != size || h->n_classes == 0 || h->n_trees == 0)
+        throw dsp_error(Errc::invalid_model);
+
+    Layout l(h->n_trees, h->n_nodes, h->n_leaves * h->n_classes, sizeof(Header));
+    if (l.size != size || h->n_nodes == 0 || h->n_leaves == 0)
+        throw dsp_error(Errc::invalid_model);
+
+    // predict doesn't check the indices of the tables, check them once here
+    auto roots     = reinterpret_cast<const uint32_t*>(base + l.roots);
+    auto depths    = reinterpret_cast<const uint32_t*>(base + l.depths);
+    auto feature   = reinterpret_cast<const uint32_t*>(base + l.feature);
+    auto child     = reinterpret_cast<const uint32_t*>(base + l.child);
+    auto leaf      = reinterpret_cast<const uint32_t*>(base + l.leaf);
+    auto threshold = reinterpret_cast<const double*>(base + l.threshold);
+    const uint64_t n_nodes = h->n_nodes;
+    for (uint32_t t = 0; t < h->n_trees; ++t) {
+        // a tree without features is a single leaf, never walked
+        if (roots[t] >= n_nodes || depths[t] > n_nodes || (h->n_features == 0 && depths[t] != 0))
+            throw dsp_error(Errc::invalid_model, "tree " + std::to_string(t) + " out of bounds");
+    }
+    const double inf = std::numeric_limits<double>::infinity();
+    for (uint64_t i = 0; i < n_nodes; ++i) {
+        // the leaves loop on themselves, the other nodes have two children
+        const bool is_leaf = child[i] == i && threshold[i] == inf;
+        if (child[i] >= n_nodes || (!is_leaf && child[i] + uint64_t(1) >= n_nodes) ||
+            (h->n_features && feature[i] >= h->n_features) || leaf[i] >= h->n_leaves)
+            throw dsp_error(Errc::invalid_model, "node " + std::to_string(i) + " out of bounds");
+    }
+
+    storage_   = std::move(storage);
+    header_    = h;
+    roots_     = reinterpret_cast<const uint32_t*>(base + l.roots);
+    depths_    = reinterpret_cast<const uint32_t*>(base + l.depths);
+    feature_   = reinterpret_cast<const uint32_t*>(base + l.feature);
+    child_     = reinterpret_cast<const uint32_t*>(base + l.child);
+    leaf_      = reinterpret_cast<const uint32_t*>(base + l.leaf);
+    threshold_ = reinterpret_cast<const double*>(base + l.threshold);
+    probs_     = reinterpret_cast<const double*>(base + l.probs);
+}
+
+void FlatForest::save(const std::filesystem::path& filename) const
+{
+    if (empty())
+        throw dsp_error(Errc::invalid_model);
+
+    // write a temporary file next to the model & rename it over the model: the
+    // forests mapping the previous file keep its inode instead of seeing it
+    // truncated & rewritten under them
+    std::string tmp = filename.string() + ".XXXXXX";
+    int fd = ::mkstemp(tmp.data());
+    if (fd < 0)
+        throw dsp_error(Errc::invalid_model);
+
+    auto fail = [&] {
+        ::close(fd);
+        ::unlink(tmp.c_str());
+        throw dsp_error(Errc::invalid_model);
+    };
+
+    auto data = static_cast<const char*>(storage_.get());
+    size_t left = header_->size;
+    while (left) {
+        ssize_t n = ::write(fd, data, left);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            fail();
+        data += n;
+        left -= n;
+    }
+    // mkstemp creates the file readable by its owner only
+    if (::fchmod(fd, 0644) != 0 || ::fsync(fd) != 0)
+        fail();
+    if (::close(fd) != 0) {
+        ::unlink(tmp.c_str());
+        throw dsp_error(Errc::invalid_model);
+    }
+
+    if (::rename(tmp.c_str(), filename.c_str()) != 0) {
+        ::unlink(tmp.c_str());
+        throw dsp_error(Errc::invalid_model);
+    }
+
+    // persist the rename
+    auto dir = filename.parent_path();
+    int dfd = ::open(dir.empty() ? "." : dir.c_str(), O_RDONLY | O_DIRECTORY);
+    if (dfd >= 0) {
+        ::fsync(dfd);
+        ::close(dfd);
+    }
+}
+
+FlatForest FlatForest::load(const std::filesystem::path& filename)
+{
+    std::error_code ec;
+    const std::string key = std::filesystem::canonical(filename, ec).string();
+    if (ec)
+        throw dsp_error(Errc::invalid_model);
+
+    std::unique_lock<std::mutex> lk(mappings_mutex);
+
+    // forget the mappings released by their last forest
+    for (auto it = mappings.begin(); it != mappings.end(); )
+        it = it->second.storage.expired() ? mappings.erase(it) : std::next(it);
+
+    int fd = ::open(key.c_str(), O_RDONLY);
+    if (fd < 0)
+        throw dsp_error(Errc::invalid_model);
+
+    struct stat st;
+    if (::fstat(fd, &st) != 0 || st.st_size < static_cast<off_t>(sizeof(Header))) {
+        ::close(fd);
+        throw dsp_error(Errc::invalid_model);
+    }
+
+    // a file replaced or modified since it was mapped is mapped again, the forests
+    // using the previous mapping keep it
+    std::shared_ptr<const void> storage;
+    auto search = mappings.find(key);
+    if (search != mappings.end() && search->second.same_file(st))
+        storage = search->second.storage.lock();
+
+    const size_t size = st.st_size;
+    if (storage) {
+        ::close(fd);
+    } else {
+        void * addr = ::mmap(nullptr, size, PROT_READ, MAP_SHARED | MAP_POPULATE, fd, 0);
+        ::close(fd);
+        if (addr == MAP_FAILED)
+            throw dsp_error(Errc::invalid_model);
+
+        storage = std::shared_ptr<const void>(addr, [size](const void * p) {
+            ::munmap(const_cast<void*>(p), size);
+        });
+        mappings[key] = {storage, st.st_dev, st.st_ino, st.st_size, st.st_mtim};
+    }
+
+    FlatForest f;
+    f.bind(std::move(storage), size);
+    return f;
+}
+
+} /* namespace dsp */
@@ -0,0 +1,156 @@
+#include <algorithm>
+#include <set>
+#include <utility>
+
+#include "dsp/graph.h"
+
+namespace dsp {
+
+Graph& Graph::add(const std::string& name, const std::string& type, const Params& params,
+                  const Registry& registry)
+{
+    if (!registry.contains(type))
+        throw dsp_error(Errc::invalid_graph, "unknown filter type '" + type + "' for '" + name + "'");
+
+    auto factory = registry.factory(type);
+    return add(name, [factory, params](common::Logger logger, const std::string& n) {
+        return factory(logger, n, params);
+    });
+}
+
+Graph& Graph::add(const std::string& name, Factory factory)
+{
+    if (find(name))
+        throw dsp_error(Errc::invalid_graph, "duplicate filter '" + name + "'");
+    nodes_.push_back({name, std::move(factory), {}});
+    invalidate();
+    return *this;
+}
+
+Graph& Graph::set_format(const std::string& name, const std::string& pad, const Format& fmt)
+{
+    auto node = find(name);
+    if (!node)
+        throw dsp_error(Errc::invalid_graph, "format set on unknown filter '" + name + "'");
+    node->formats[pad] = fmt;
+    invalidate();
+    return *this;
+}
+
+void Graph::validate() const
+{
+    if (validated_)
+        return;
+
+    std::set<std::string> inputs, outputs;
+    for (auto& e: edges_) {
+        auto src = find(e.src);
+        if (!src)
+            throw dsp_error(Errc::invalid_graph, "link " + e.name() + ": unknown filter '" + e.src + "'");
+        if (!find(e.dst))
+            throw dsp_error(Errc::invalid_graph, "link " + e.name() + ": unknown filter '" + e.dst + "'");
+        if (!inputs.insert(e.dst + "." + e.dst_pad).second)
+            throw dsp_error(Errc::invalid_graph, "link " + e.name() + ": input already linked");
+        if (!outputs.insert(e.src + "." + e.src_pad).second)
+            throw dsp_error(Errc::invalid_graph, "link " + e.name() + ": output already linked (use a tee)");
+        // outputs of sources can't be derived
+        bool source = std::none_of(edges_.cbegin(), edges_.cend(), [&e](auto& x) {return x.dst == e.src;});
+        if (source && src->formats.find(e.src_pad) == src->formats.end())
+            throw dsp_error(Errc::invalid_graph, "link " + e.name() + ": no format for source output " +
+                            e.src + "." + e.src_pad);
+    }
+
+    for (auto& n: nodes_) {
+        bool linked = std::any_of(edges_.cbegin(), edges_.cend(), [&n](auto& e) {
+            return e.src == n.name || e.dst == n.name;
+        });
+        if (!linked)
+            throw dsp_error(Errc::invalid_graph, "filter '" + n.name + "' isn't linked");
+    }
+
+    validated_ = true;
+}
+
+std::unique_ptr<Pipeline> Graph::instantiate(common::Logger logger) const
+{
+    // the pads resolved by a previous instantiation: the description was validated
+    std::map<std::string, Pads> resolved;
+    {
+        std::unique_lock<std::mutex> lk(mutex_);
+        resolved = resolved_;
+    }
+    const bool cached = !resolved.empty();
+    if (!cached)
+        validate();
+
+    auto pipeline = std::make_unique<Pipeline>(logger);
+
+    std::map<std::string, Filter*> handles;
+    for (auto& n: nodes_) {
+        std::unique_ptr<Filter> f;
+        try {
+            f = n.factory(logger, n.name);
+        } catch (dsp_error& e) {
+            throw dsp_error(static_cast<Errc>(e.code().value()), "filter '" + n.name + "': " + e.what());
+        }
+        if (!f || f->name() != n.name)
+            throw dsp_error(Errc::invalid_graph, "factory of '" + n.name + "' didn't use its name");
+        handles[n.name] = pipeline->add_filter(std::move(f));
+    }
+
+    if (cached) {
+        for (auto& [name, pads]: resolved)
+            handles[name]->restore_pads(pads.inputs, pads.outputs);
+    } else {
+        for (auto& n: nodes_) {
+            for (auto& [pad, fmt]: n.formats) {
+                if (handles[n.name]->output_pads().count(pad) == 0)
+                    throw dsp_error(Errc::invalid_graph, "format set on unknown output " + n.name + "." + pad);
+                handles[n.name]->set_output_format(fmt, pad);
+            }
+        }
+    }
+
+    for (auto& e: edges_) {
+        Filter * src = handles[e.src];
+        Filter * dst = handles[e.dst];
+        if (!cached && src->output_pads().count(e.src_pad) == 0)
+            throw dsp_error(Errc::invalid_graph, "link " + e.name() + ": unknown output pad");
+        if (!cached && dst->input_pads().count(e.dst_pad) == 0)
+            throw dsp_error(Errc::invalid_graph, "link " + e.name() + ": unknown input pad");
+        e.connect(*pipeline, src, e.src_pad, dst, e.dst_pad);
+    }
+
+    if (pipeline->negotiate_format(!cached) != Contract::supported_format)
+        throw dsp_error(Errc::format_negotiation_failed, pipeline->negotiation_error());
+
+    if (!cached) {
+        for (auto& [name, f]: handles)
+            resolved[name] = {f->input_pads(), f->output_pads()};
+        std::unique_lock<std::mutex> lk(mutex_);
+        if (resolved_.empty())
+            resolved_ = std::move(resolved);
+    }
+
+    return pipeline;
+}
+
+void Graph::invalidate()
+{
+    std::unique_lock<std::mutex> lk(mutex_);
+    validated_ = false;
+    resolved_.clear();
+}
+
+const Graph::Node * Graph::find(const std::string& name) const
+{
+    auto it = std::find_if(nodes_.cbegin(), nodes_.cend(), [&name](auto& n) {return n.name == name;});
+    return it != nodes_.cend() ? &*it : nullptr;
+}
+
+Graph::Node * Graph::find(const std::string& name)
+{
+    return const_cast<Node*>(std::as_const(*this).find(name));
+}
+
+} /* namespace dsp */
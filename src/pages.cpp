@@ -0,0 +1,112 @@
+#include <sys/mman.h>
+#include <sys/resource.h>
+
+#include <atomic>
+#include <cstring>
+#include <new>
+#include <utility>
+
+#include "dsp/pages.h"
+
+namespace dsp {
+
+namespace {
+
+std::atomic<uint64_t> n_hugetlb {0};
+std::atomic<uint64_t> n_thp {0};
+std::atomic<uint64_t> bytes_mapped {0};
+
+std::size_t round_up(std::size_t n)
+{
+    return (n + HugePages::huge_page_size - 1) & ~(HugePages::huge_page_size - 1);
+}
+
+} /* namespace */
+
+HugePages::HugePages(std::size_t n, bool prefault):
+    size_(round_up(n))
+{
+    const int populate = prefault ? MAP_POPULATE : 0;
+
+#ifdef MAP_HUGETLB
+    void * p = mmap(nullptr, size_, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | populate, -1, 0);
+    if (p != MAP_FAILED) {
+        addr_    = p;
+        hugetlb_ = true;
+        n_hugetlb++;
+        bytes_mapped += size_;
+        return;
+    }
+#endif
+
+    // no reserved huge pages: map one more huge page to align the mapping on a huge
+    // page boundary, the khugepaged can't collapse the unaligned parts otherwise
+    const std::size_t len = size_ + huge_page_size;
+    auto base = static_cast<std::byte*>(mmap(nullptr, len, PROT_READ | PROT_WRITE,
+                                             MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+    if (base == MAP_FAILED)
+        throw std::bad_alloc();
+
+    auto aligned = reinterpret_cast<std::byte*>(round_up(reinterpret_cast<std::uintptr_t>(base)));
+    const std::size_t head = aligned - base;
+    if (head)
+        munmap(base, head);
+    if (huge_page_size - head)
+        munmap(aligned + size_, huge_page_size - head);
+
+    addr_ = aligned;
+    madvise(addr_, size_, MADV_HUGEPAGE);
+    // populated after the madvise, otherwise the pages would be small ones
+    if (prefault)
+        std::memset(addr_, 0, size_);
+    n_thp++;
+    bytes_mapped += size_;
+}
+
+HugePages::~HugePages()
+{
+    release();
+}
+
+HugePages::HugePages(HugePages&& p) noexcept:
+    addr_(std::exchange(p.addr_, nullptr)),
+    size_(std::exchange(p.size_, 0)),
+    hugetlb_(p.hugetlb_)
+{
+}
+
+HugePages& HugePages::operator=(HugePages&& p) noexcept
+{
+    if (this != &p) {
+        release();
+        addr_    = std::exchange(p.addr_, nullptr);
+        size_    = std::exchange(p.size_, 0);
+        hugetlb_ = p.hugetlb_;
+    }
+    return *this;
+}
+
+void HugePages::release()
+{
+    if (!addr_)
+        return;
+    munmap(addr_, size_);
+    bytes_mapped -= size_;
+    addr_ = nullptr;
+    size_ = 0;
+}
+
+HugePages::Stats HugePages::stats()
+{
+    return {n_hugetlb, n_thp, bytes_mapped};
+}
+
+PageFaults PageFaults::now()
+{
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return {static_cast<uint64_t>(usage.ru_minflt), static_cast<uint64_t>(usage.ru_majflt)};
+}
+
+} /* namespace dsp */
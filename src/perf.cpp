@@ -0,0 +1,102 @@
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstring>
+#include <iterator>
+
+#include "dsp/perf.h"
+
+namespace dsp::perf {
+
+namespace {
+
+struct Event
+{
+    uint32_t type;
+    uint64_t config;
+};
+
+// same order as the fields of Counters
+constexpr Event events[] = {
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+    {PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_DTLB |
+                         (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                         (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)},
+};
+
+int open_event(const Event& e, int group)
+{
+    struct perf_event_attr attr;
+    std::memset(&attr, 0, sizeof(attr));
+    attr.size           = sizeof(attr);
+    attr.type           = e.type;
+    attr.config         = e.config;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv     = 1;
+    attr.read_format    = PERF_FORMAT_GROUP;
+    // calling thread, any cpu
+    return syscall(SYS_perf_event_open, &attr, 0, -1, group, 0);
+}
+
+} /* namespace */
+
+ThreadCounters& ThreadCounters::current()
+{
+    thread_local ThreadCounters counters;
+    return counters;
+}
+
+ThreadCounters::ThreadCounters()
+{
+    static_assert(std::size(events) == n_events);
+
+    int n = 0;
+    for (std::size_t i = 0; i < n_events; ++i) {
+        fds_[i]   = open_event(events[i], leader_);
+        index_[i] = fds_[i] >= 0 ? n++ : -1;
+        if (i == 0 && fds_[i] < 0)
+            return;
+        if (i == 0)
+            leader_ = fds_[0];
+    }
+}
+
+ThreadCounters::~ThreadCounters()
+{
+    if (leader_ < 0)
+        return;
+    for (auto fd: fds_)
+        if (fd >= 0)
+            close(fd);
+}
+
+Counters ThreadCounters::read() const
+{
+    Counters c;
+    c.time_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+    if (leader_ < 0)
+        return c;
+
+    // { nr, values[nr] }
+    uint64_t buf[1 + n_events];
+    if (::read(leader_, buf, sizeof(buf)) < static_cast<ssize_t>(sizeof(uint64_t)))
+        return c;
+
+    auto value = [&](std::size_t i) -> uint64_t {
+        return index_[i] >= 0 && static_cast<uint64_t>(index_[i]) < buf[0] ? buf[1 + index_[i]] : 0;
+    };
+    c.cycles        = value(0);
+    c.instructions  = value(1);
+    c.cache_misses  = value(2);
+    c.branch_misses = value(3);
+    c.dtlb_misses   = value(4);
+    return c;
+}
+
+} /* namespace dsp::perf */
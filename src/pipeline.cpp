@@ -1,3 +1,11 @@
+#include <pthread.h>
+#include <sched.h>
+
+#include <algorithm>
+#include <iterator>
+#include <set>
+#include <unordered_set>
+
 #include "dsp/pipeline.h"
 
 namespace dsp {
@@ -7,29 +15,206 @@ Pipeline::Pipeline(common::Logger logger): Log(logger)
     reset_stats();
 }
 
+Pipeline::~Pipeline()
+{
+    stop_domains();
+
+    // the filters may own FFTW plans
+    std::unique_lock<std::recursive_mutex> lk(fftw::planner_mutex());
+    filters_.clear();
+    links_.clear();
+}
+
 void Pipeline::reset()
 {
+    std::unique_lock<std::shared_mutex> lk(exec_mutex_);
+    for (auto& [name, f]: filters_)
+        f->reset();
     for (auto& l: links_) {
+        l->clear();
         l->reset_eof();
     }
-    /* TODO: reset filters <30-10-20, cneyton> */
 }
 
-void Pipeline::run()
+void Pipeline::pause()
 {
-    while (run_once()) { }
+    // wait for the running activation to complete
+    std::unique_lock<std::shared_mutex> lk(exec_mutex_);
+    paused_ = true;
 }
 
-void Pipeline::stop()
+void Pipeline::resume()
 {
+    paused_ = false;
+    wakeup();
+}
+
+Contract Pipeline::reconfigure(const std::vector<Filter*>& filters,
+                               const std::function<void()>& apply,
+                               const std::function<void()>& revert)
+{
+    Contract ret;
     {
-        std::unique_lock<std::mutex> lk(mutex_);
-        // set eof on all links
+        std::unique_lock<std::shared_mutex> lk(exec_mutex_);
+
+        // the modified filters & everything downstream
+        auto sorted = sorted_filters();
+        std::set<Filter*> affected(filters.cbegin(), filters.cend());
+        for (auto f: sorted) {
+            if (!affected.count(f))
+                continue;
+            for (auto& l: links_)
+                if (l->src() == f)
+                    affected.insert(l->dst());
+        }
+
+        std::vector<Filter*> subgraph;
+        std::copy_if(sorted.cbegin(), sorted.cend(), std::back_inserter(subgraph),
+                     [&affected](auto f) {return affected.count(f) != 0;});
+
+        // formats & pools to restore if the new configuration is rejected
+        std::map<Filter*, std::pair<std::map<std::string, Pad>, std::map<std::string, Pad>>> pads;
+        for (auto f: subgraph)
+            pads[f] = {f->input_pads(), f->output_pads()};
+        std::map<LinkInterface*, arma::uword> allocations;
+        for (auto& l: links_)
+            allocations[l.get()] = l->n_allocations();
+
+        std::unique_lock<std::recursive_mutex> planner_lk(fftw::planner_mutex());
+        apply();
+        ret = negotiate(subgraph);
+
+        if (ret != Contract::supported_format) {
+            // back to the previous configuration, the chunks in flight are kept
+            const std::string error = negotiation_error_;
+            if (revert)
+                revert();
+            for (auto& [f, p]: pads)
+                f->restore_pads(p.first, p.second);
+            if (negotiate(subgraph) != Contract::supported_format)
+                log_error(logger_, "unable to restore the configuration of the pipeline");
+            negotiation_error_ = error;
+        } else {
+            // chunks produced with the previous configuration are dropped
+            for (auto& l: links_)
+                if (affected.count(l->src()))
+                    l->clear();
+            for (auto f: subgraph)
+                f->reset();
+        }
+
+        // the pools reallocated by the negotiation are allocated again by the domain
+        // writing them (first-touch)
         for (auto& l: links_) {
-            l->eof();
+            if (running_ && l->n_allocations() != allocations[l.get()] &&
+                !domain(l->src()).empty() && l->defer_reallocation())
+                n_deferred_++;
         }
     }
-    cv_.notify_all();
+    wakeup();
+    return ret;
+}
+
+void Pipeline::run()
+{
+    while (run_once()) { }
+}
+
+void Pipeline::add_domain(const std::string& name, const std::vector<int>& cpus)
+{
+    if (name.empty() || running_)
+        throw dsp_error(Errc::invalid_parameters, "domain '" + name + "'");
+    domains_[name].cpus = cpus;
+}
+
+void Pipeline::assign(const std::vector<Filter*>& filters, const std::string& domain)
+{
+    if (running_ || domains_.find(domain) == domains_.end())
+        throw dsp_error(Errc::invalid_parameters, "domain '" + domain + "'");
+    for (auto f: filters) {
+        if (f->pipeline() != this)
+            throw dsp_error(Errc::invalid_parameters, "filter '" + f->name() + "'");
+        assignment_[f] = domain;
+    }
+}
+
+void Pipeline::start_domains()
+{
+    if (running_ || domains_.empty())
+        return;
+
+    // hand-off points between the threads
+    for (auto& l: links_)
+        if (domain(l->src()) != domain(l->dst()))
+            l->set_concurrent([this]() {wakeup();});
+
+    running_ = true;
+    for (auto& [name, d]: domains_)
+        d.thread = std::thread(&Pipeline::run_domain, this, name);
+}
+
+void Pipeline::stop_domains()
+{
+    if (!running_)
+        return;
+    running_ = false;
+    wakeup();
+    for (auto& [name, d]: domains_)
+        if (d.thread.joinable())
+            d.thread.join();
+}
+
+const std::string& Pipeline::domain(const Filter * f) const
+{
+    static const std::string none;
+    auto search = assignment_.find(f);
+    return search != assignment_.end() ? search->second : none;
+}
+
+bool Pipeline::domain_ready(const std::string& domain) const
+{
+    if (paused_)
+        return false;
+    for (auto& [name, f]: filters_) {
+        if ((f->is_ready() || f->is_wanted()) && this->domain(f.get()) == domain &&
+            !throttled(f.get()))
+            return true;
+    }
+    return false;
+}
+
+void Pipeline::run_domain(const std::string& name)
+{
+    auto& cpus = domains_.at(name).cpus;
+    if (!cpus.empty()) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        for (auto c: cpus)
+            CPU_SET(c, &set);
+        if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0)
+            log_warn(logger_, "unable to pin domain {}", name);
+    }
+
+    // the chunks are written by the source filter: allocate them on its node
+    for (auto& l: links_)
+        if (domain(l->src()) == name)
+            l->reallocate();
+
+    while (running_) {
+        {
+            std::unique_lock<std::mutex> lk(mutex_);
+            cv_.wait(lk, [this, &name]() {return !running_ || domain_ready(name);});
+        }
+        while (running_ && run_once(name)) { }
+    }
+}
+
+void Pipeline::stop()
+{
+    // set eof on all links (wakes up their destination)
+    for (auto& l: links_)
+        l->eof_reached();
+    wakeup();
 }
 
 void Pipeline::wakeup()
@@ -43,14 +228,7 @@ void Pipeline::wakeup()
 void Pipeline::wait()
 {
     std::unique_lock<std::mutex> lk(mutex_);
-    cv_.wait(lk, [this]()
-        {
-            for (auto it = filters_.cbegin(); it != filters_.cend(); ++it) {
-                if (it->second->is_ready())
-                    return true;
-            }
-            return false;
-        });
+    cv_.wait(lk, [this]() {return domain_ready("");});
 }
 
 Filter * Pipeline::add_filter(std::unique_ptr<Filter> filter)
@@ -59,6 +237,8 @@ Filter * Pipeline::add_filter(std::unique_ptr<Filter> filter)
         throw dsp_error(Errc::duplicate_filter);
     Filter * handle = filter.get();
     filter->set_pipeline(this);
+    filter->set_batch_size(batch_size_);
+    filter_tracks_[handle] = tracer_.track(filter->name());
     filters_[filter->name()] = std::move(filter);
     return handle;
 }
@@ -72,16 +252,86 @@ Filter * Pipeline::get_filter(const std::string& name)
         return nullptr;
 }
 
-Contract Pipeline::negotiate_format()
+std::vector<Filter*> Pipeline::sorted_filters() const
 {
-    for (auto it = filters_.cbegin(); it != filters_.cend(); ++it) {
-        if (it->second->negotiate_format() != Contract::supported_format)
+    // Kahn's algorithm, filters with the same depth in name order
+    std::map<Filter*, arma::uword> n_inputs;
+    for (auto& [name, f]: filters_)
+        n_inputs[f.get()] = 0;
+    for (auto& l: links_)
+        n_inputs[l->dst()]++;
+
+    std::vector<Filter*> sorted;
+    for (auto& [name, f]: filters_)
+        if (n_inputs[f.get()] == 0)
+            sorted.push_back(f.get());
+
+    for (arma::uword i = 0; i < sorted.size(); ++i) {
+        for (auto& l: links_) {
+            if (l->src() == sorted[i] && --n_inputs[l->dst()] == 0)
+                sorted.push_back(l->dst());
+        }
+    }
+
+    // filters in a loop are negotiated last, in name order
+    if (sorted.size() != filters_.size()) {
+        log_warn(logger_, "the pipeline has a loop, formats won't be propagated through it");
+        for (auto& [name, f]: filters_)
+            if (n_inputs[f.get()] != 0)
+                sorted.push_back(f.get());
+    }
+
+    return sorted;
+}
+
+Contract Pipeline::negotiate_format(bool propagate)
+{
+    std::unique_lock<std::recursive_mutex> lk(fftw::planner_mutex());
+    return negotiate(sorted_filters(), propagate);
+}
+
+Contract Pipeline::negotiate(const std::vector<Filter*>& filters, bool propagate)
+{
+    negotiation_error_.clear();
+
+    // upstream filters first, so that the input formats of a filter are known
+    // (derived from the formats of the outputs they're linked to) when it derives
+    // its own output formats
+    for (auto f: filters) {
+        if (propagate) {
+            for (auto& l: links_)
+                if (l->dst() == f)
+                    l->propagate_format();
+
+            f->propagate_format();
+        }
+
+        if (f->negotiate_format() != Contract::supported_format) {
+            negotiation_error_ = "filter '" + f->name() + "' rejected its formats:";
+            for (auto& [name, pad]: f->input_pads())
+                negotiation_error_ += " in." + name + " " + to_string(pad.format);
+            for (auto& [name, pad]: f->output_pads())
+                negotiation_error_ += " out." + name + " " + to_string(pad.format);
+            log_error(logger_, "{}", negotiation_error_);
             return Contract::unsupported_format;
+        }
     }
 
+    // the links allocate their pools with the resolved formats (kept if unchanged)
     for (auto& l: links_) {
-        if (l->negotiate_format() != Contract::supported_format)
+        if (std::find(filters.cbegin(), filters.cend(), l->dst()) == filters.cend())
+            continue;
+        l->set_huge_pages(huge_pages_);
+        if (l->negotiate_format() != Contract::supported_format) {
+            negotiation_error_ = "link " + l->name() + " has mismatching formats " +
+                to_string(l->src()->get_output_format(l->src_pad())) + " & " +
+                to_string(l->dst()->get_input_format(l->dst_pad()));
+            log_error(logger_, "{}", negotiation_error_);
             return Contract::unsupported_format;
+        }
+        if (l->transposing())
+            log_debug(logger_, "link {} transposes {} to {}", l->name(),
+                      to_string(l->src_format()), to_string(l->format()));
     }
 
     return Contract::supported_format;
@@ -89,65 +339,280 @@ Contract Pipeline::negotiate_format()
 
 void Pipeline::print_stats()
 {
+    arma::uword n_activations = 0, n_idle = 0;
     for (auto it = filters_.cbegin(); it != filters_.cend(); ++it) {
         auto& f = it->second;
+        const auto c = f->perf_counters();
+        n_activations += f->n_activations();
+        n_idle        += f->n_idle_activations();
         std::cout << "filter "       << f->name() << "\n"
             << "\tn_execs: "         << f->n_execs() << "\n"
             << "\ttotal exec time: " << f->total_exec_time().count() << " s\n"
-            << "\tmean exec time: "  << f->mean_exec_time().count() << " s\n";
+            << "\tmean exec time: "  << f->mean_exec_time().count() << " s\n"
+            << "\tactivations: "     << f->n_activations()
+            << " (" << f->n_idle_activations() << " idle)\n";
+        if (c.cycles) {
+            std::cout << "\tcycles: "    << c.cycles
+                << " (IPC " << static_cast<double>(c.instructions) / c.cycles << ")\n"
+                << "\tcache misses: "  << c.cache_misses << "\n"
+                << "\tbranch misses: " << c.branch_misses << "\n"
+                << "\tdTLB misses: "   << c.dtlb_misses << "\n";
+        }
     }
     std::cout << "------------------------------\n"
         << "Pipeline\n"
         << "\tn_execs: " << n_execs() << "\n"
-        << "\ttot exec time: " << total_exec_time().count() << " s\n";
+        << "\ttot exec time: " << total_exec_time().count() << " s\n"
+        << "\tactivations: " << n_activations << " (" << n_idle << " idle)\n"
+        << "\tforwarded requests: " << n_forwarded_ << "\n";
+    std::cout << "\tmemory: " << memory_usage() << " B (peak " << peak_memory_usage()
+        << " B, budget " << memory_budget() << " B, " << n_throttled() << " throttled)\n";
+    for (auto it = filters_.cbegin(); it != filters_.cend(); ++it) {
+        auto& f = it->second;
+        if (f->peak_memory())
+            std::cout << "\t\t" << f->name() << ": " << f->memory() << " B (peak "
+                << f->peak_memory() << " B)\n";
+    }
+    for (auto& l: links_) {
+        if (l->peak_queued_bytes())
+            std::cout << "\t\t" << l->name() << ": " << l->queued_bytes() << " B (peak "
+                << l->peak_queued_bytes() << " B)\n";
+    }
+    const auto faults = page_faults();
+    const auto pages  = HugePages::stats();
+    std::cout << "\tpage faults: " << faults.minor << " minor, " << faults.major << " major\n"
+        << "\thuge pages: " << pages.bytes_mapped / HugePages::huge_page_size << " mapped ("
+        << pages.n_hugetlb << " hugetlb & " << pages.n_thp << " thp mappings)\n";
+    for (const auto& [name, l]: tracer_.latencies()) {
+        std::cout << "latency " << name << "\n"
+            << "\tmean: " << l.mean / 1e6 << " ms\n"
+            << "\tmax: "  << l.max / 1e6 << " ms\n";
+    }
+    for (const auto& [name, c]: link_counters()) {
+        std::cout << "link " << name << "\n"
+            << "\tchunks: "          << c.n_chunks << "\n"
+            << "\tinvalid: "         << c.n_invalid << "\n"
+            << "\tdiscontinuities: " << c.n_discontinuities << "\n"
+            << "\tdropped: "         << c.n_dropped << "\n";
+    }
+}
+
+std::map<std::string, LinkInterface::Counters> Pipeline::link_counters() const
+{
+    std::map<std::string, LinkInterface::Counters> counters;
+    for (const auto& l: links_)
+        counters.emplace(l->name(), l->counters());
+    return counters;
 }
 
 
-void Pipeline::update_stats(std::chrono::duration<double>& duration)
+void Pipeline::update_stats(const perf::Counters& c, arma::uword n)
 {
-    stats_.n_execs++;
-    stats_.durations.push_back(duration);
+    std::unique_lock<std::mutex> lk(mutex_);
+    stats_.n_execs  += n;
+    stats_.counters += c;
 }
 
 void Pipeline::reset_stats()
 {
-    stats_.n_execs = 0;
-    stats_.durations.clear();
+    stats_.n_execs  = 0;
+    stats_.counters = perf::Counters();
+    faults_base_ = PageFaults::now();
 }
 
 std::chrono::duration<double> Pipeline::total_exec_time() const
 {
-    return std::accumulate(stats_.durations.begin(), stats_.durations.end(),
-                           std::chrono::duration<double>::zero());
+    return std::chrono::nanoseconds(stats_.counters.time_ns);
+}
+
+void Pipeline::set_profiling(bool enable)
+{
+    if (enable && !perf::ThreadCounters::current().available())
+        log_warn(logger_, "hardware counters unavailable (perf_event_paranoid?), only the "
+                 "activation times are measured");
+    for (auto& [name, f]: filters_)
+        f->set_profiling(enable);
 }
 
-int Pipeline::run_once()
+int Pipeline::run_once(const std::string& domain)
 {
+    // activations are atomic with respect to pause & reconfigure, the domains
+    // activate their filters concurrently
+    std::shared_lock<std::shared_mutex> lk(exec_mutex_);
+    if (paused_)
+        return 0;
+
+    if (n_deferred_) {
+        for (auto& l: links_)
+            if (this->domain(l->src()) == domain && l->reallocate_deferred())
+                n_deferred_--;
+    }
+
+    // filters with something to process first
     for (auto it = filters_.cbegin(); it != filters_.cend(); ++it) {
-        auto& f = it->second;
-        if (f->is_ready()) {
-            try {
-#ifdef DSP_PROFILE
-                auto start = std::chrono::high_resolution_clock::now();
-#endif
-                [[maybe_unused]] int ret = f->activate();
-                f->reset_ready();
-#ifdef DSP_PROFILE
-                if (ret) {
-                    auto stop = std::chrono::high_resolution_clock::now();
-                    std::chrono::duration<double> diff = stop - start;
-                    f->update_stats(diff);
-                    update_stats(diff);
-                }
-#endif
-            } catch (...) {
-                log_error(logger_, "failed to activate filter {}", f->name());
-                /* TODO: manage error (rethrow exception ?) <23-10-20, cneyton> */
+        auto f = it->second.get();
+        if (f->is_ready() && this->domain(f) == domain) {
+            if (throttled(f)) {
+                // its queue may still grow
+                f->account_memory();
+                n_throttled_++;
+                continue;
             }
+            activate(f);
+            return 1;
+        }
+    }
+
+    // then the requests of the downstream filters
+    for (auto it = filters_.cbegin(); it != filters_.cend(); ++it) {
+        auto f = it->second.get();
+        if (f->is_wanted() && this->domain(f) == domain) {
+            if (throttled(f)) {
+                // its queue may still grow
+                f->account_memory();
+                n_throttled_++;
+                continue;
+            }
+            f->reset_wanted();
+            if (scheduling_ == Scheduling::demand && forward_request(f))
+                return 1;
+            activate(f);
             return 1;
         }
     }
     return 0;
 }
 
+void Pipeline::activate(Filter * f)
+{
+    // reset first: the filter may be made ready again by another domain during the
+    // activation
+    f->reset_ready();
+    f->reset_wanted();
+    const int64_t trace_start = tracer_.enabled() ? trace::now() : 0;
+    // the flag is read once: the profiling may be switched during the activation
+    const bool profiling = f->profiling();
+    perf::Counters start;
+    if (profiling)
+        start = perf::ThreadCounters::current().read();
+
+    arma::uword n = 0;
+    try {
+        int ret;
+        do {
+            ret = f->activate();
+            if (n == 0)
+                f->count_activation(ret == 0);
+        } while (ret && ++n != batch_size_);
+    } catch (...) {
+        log_error(logger_, "failed to activate filter {}", f->name());
+        /* TODO: manage error (rethrow exception ?) <23-10-20, cneyton> */
+    }
+
+    if (profiling && n) {
+        const auto c = perf::ThreadCounters::current().read() - start;
+        f->update_stats(c, n);
+        update_stats(c, n);
+    }
+    if (trace_start && n)
+        tracer_.activation(filter_tracks_.at(f), trace_start, trace::now());
+
+    f->account_memory();
+    check_budget(domain(f));
+}
+
+void Pipeline::set_memory_budget(std::size_t bytes, MemoryPolicy policy)
+{
+    std::unique_lock<std::shared_mutex> lk(exec_mutex_);
+    budget_      = bytes;
+    policy_      = policy;
+    over_budget_ = false;
+    wakeup();
+}
+
+std::size_t Pipeline::memory_usage() const
+{
+    // the chunks pushed on several links (by a Tee) are counted once
+    std::unordered_set<const void*> counted;
+    std::size_t usage = 0;
+    for (auto& l: links_)
+        usage += l->queued_bytes(counted);
+    for (auto& [name, f]: filters_)
+        usage += f->memory();
+    return usage;
+}
+
+void Pipeline::check_budget(const std::string& domain)
+{
+    auto usage = memory_usage();
+    auto peak  = peak_memory_.load();
+    while (usage > peak && !peak_memory_.compare_exchange_weak(peak, usage)) { }
+
+    const std::size_t budget = budget_;
+    if (budget == 0 || usage <= budget) {
+        // back under the budget: the throttled sources may run again
+        if (over_budget_.exchange(false))
+            wakeup();
+        return;
+    }
+
+    if (policy_ == MemoryPolicy::degrade) {
+        while (usage > budget) {
+            // only the links safe to modify from this domain
+            LinkInterface * fullest = nullptr;
+            for (auto& l: links_) {
+                if (!l->concurrent() && this->domain(l->dst()) != domain)
+                    continue;
+                if (l->queued_bytes() && (!fullest || l->queued_bytes() > fullest->queued_bytes()))
+                    fullest = l.get();
+            }
+            if (!fullest || !fullest->drop_front())
+                break;
+            log_debug(logger_, "over budget ({} > {} B), chunk dropped on {}", usage, budget,
+                      fullest->name());
+            usage = memory_usage();
+        }
+    }
+    const bool over = usage > budget;
+    if (over_budget_.exchange(over) && !over)
+        wakeup();
+}
+
+bool Pipeline::throttled(const Filter * f) const
+{
+    if (!over_budget_ || policy_ != MemoryPolicy::backpressure || !f->input_pads().empty())
+        return false;
+
+    // the source still runs if nothing else can free memory: a filter that is ready
+    // or wanted but has nothing on its inputs wouldn't consume anything
+    for (auto& [name, other]: filters_) {
+        if (other->input_pads().empty() || !(other->is_ready() || other->is_wanted()))
+            continue;
+        for (auto& l: links_)
+            if (l->dst() == other.get() && (l->n_queued() || l->eof()))
+                return true;
+    }
+    return false;
+}
+
+bool Pipeline::forward_request(Filter * f)
+{
+    bool has_inputs = false;
+    for (auto& l: links_) {
+        if (l->dst() != f)
+            continue;
+        has_inputs = true;
+        if (!l->empty() || l->eof())
+            return false;
+    }
+    if (!has_inputs)
+        return false;
+
+    for (auto& l: links_)
+        if (l->dst() == f)
+            l->request();
+    n_forwarded_++;
+    return true;
+}
+
 } /* namespace dsp */
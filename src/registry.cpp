@@ -0,0 +1,89 @@
+#include "dsp/graph.h"
+#include "dsp/buffer_filter.h"
+#include "dsp/decimate_filter.h"
+#include "dsp/fd_filter.h"
+#include "dsp/fft_convolve_filter.h"
+#include "dsp/fhr_filter.h"
+#include "dsp/iir_filter.h"
+#include "dsp/resample_filter.h"
+#include "dsp/roll_filter.h"
+#include "dsp/tee_filter.h"
+
+namespace dsp {
+
+namespace {
+
+template<typename T>
+void add_filters(Registry& r, const std::string& t)
+{
+    r.add("iir<" + t + ">", [](common::Logger logger, const std::string& name, const Params& p) {
+        return std::make_unique<filter::IIR<T, double>>(logger, name, param<arma::vec>(p, "b"),
+                                                        param<arma::vec>(p, "a"));
+    });
+    r.add("roll<" + t + ">", [](common::Logger logger, const std::string& name, const Params& p) {
+        return std::make_unique<filter::Roll<T>>(logger, name, param<arma::uword>(p, "skip"));
+    });
+    r.add("buffer<" + t + ">", [](common::Logger logger, const std::string& name, const Params&) {
+        return std::make_unique<filter::Buffer<T>>(logger, name);
+    });
+    r.add("tee2<" + t + ">", [](common::Logger logger, const std::string& name, const Params&) {
+        return std::make_unique<filter::Tee<T, 2>>(logger, name);
+    });
+    r.add("decimate<" + t + ">", [](common::Logger logger, const std::string& name, const Params& p) {
+        return std::make_unique<filter::Decimate<T>>(logger, name, param<arma::uword>(p, "factor"),
+                                                     param<arma::vec>(p, "taps", arma::vec()));
+    });
+    r.add("resample<" + t + ">", [](common::Logger logger, const std::string& name, const Params& p) {
+        return std::make_unique<filter::Resample<T>>(logger, name, param<arma::uword>(p, "up"),
+                                                     param<arma::uword>(p, "down"),
+                                                     param<arma::vec>(p, "taps", arma::vec()));
+    });
+    r.add("fft_convolve<" + t + ">", [](common::Logger logger, const std::string& name, const Params& p) {
+        return std::make_unique<filter::FFTConvolve<T>>(logger, name, param<arma::vec>(p, "taps"),
+                                                        param<arma::uword>(p, "block_size", 0),
+                                                        param<arma::uword>(p, "fft_threshold", 64));
+    });
+}
+
+Registry make_registry()
+{
+    Registry r;
+    add_filters<arma::cx_double>(r, "cx_double");
+    add_filters<double>(r, "double");
+
+    r.add("fd<cx_double>", [](common::Logger logger, const std::string& name, const Params& p) {
+        const auto nfft = param<arma::uword>(p, "nfft");
+        return std::make_unique<filter::FD<arma::cx_double, double>>(
+                logger, name, nfft, param<arma::vec>(p, "window", arma::vec(nfft, arma::fill::ones)));
+    });
+    r.add("fhr<double>", [](common::Logger logger, const std::string& name, const Params& p) {
+        return std::make_unique<filter::FHR<double, double, double>>(
+                logger, name, param<arma::uword>(p, "radius"), param<arma::uword>(p, "period_max"),
+                param<double>(p, "threshold"));
+    });
+    return r;
+}
+
+} /* namespace */
+
+Registry& Registry::instance()
+{
+    static Registry r = make_registry();
+    return r;
+}
+
+void Registry::add(const std::string& type, Factory factory)
+{
+    if (!factories_.emplace(type, std::move(factory)).second)
+        throw dsp_error(Errc::duplicate_filter, type);
+}
+
+const Registry::Factory& Registry::factory(const std::string& type) const
+{
+    auto it = factories_.find(type);
+    if (it == factories_.end())
+        throw dsp_error(Errc::invalid_graph, "unknown filter type '" + type + "'");
+    return it->second;
+}
+
+} /* namespace dsp */
@@ -0,0 +1,187 @@
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <unordered_map>
+
+#include "dsp/trace.h"
+
+namespace dsp::trace {
+
+namespace {
+
+std::atomic<uint64_t> last_id {0};
+std::atomic<uint64_t> last_tracer {0};
+
+std::string escape(const std::string& s)
+{
+    std::string out;
+    for (char c: s) {
+        if (c == '"' || c == '\\')
+            out += '\\';
+        out += c;
+    }
+    return out;
+}
+
+// Chrome trace timestamps are in us
+std::string us(int64_t ns)
+{
+    char buf[32];
+    std::snprintf(buf, sizeof(buf), "%.3f", ns / 1e3);
+    return buf;
+}
+
+} /* namespace */
+
+uint64_t next_id()
+{
+    return ++last_id;
+}
+
+Tracer::Tracer(std::size_t max_events):
+    id_(++last_tracer), max_events_(max_events)
+{
+}
+
+uint32_t Tracer::track(const std::string& name)
+{
+    std::unique_lock<std::mutex> lk(mutex_);
+    auto it = std::find(tracks_.cbegin(), tracks_.cend(), name);
+    if (it != tracks_.cend())
+        return it - tracks_.cbegin();
+    tracks_.push_back(name);
+    return tracks_.size() - 1;
+}
+
+void Tracer::activation(uint32_t track, int64_t start, int64_t end)
+{
+    record({Kind::activation, track, 0, start, end - start, 0});
+}
+
+void Tracer::wait(uint32_t track, uint64_t trace_id, int64_t pushed, int64_t popped)
+{
+    record({Kind::wait, track, trace_id, pushed, popped - pushed, 0});
+}
+
+void Tracer::latency(uint32_t track, uint64_t trace_id, int64_t ingress_first,
+                     int64_t ingress_last, int64_t t)
+{
+    record({Kind::latency, track, trace_id, t, t - ingress_last, t - ingress_first});
+}
+
+Tracer::Buffer& Tracer::buffer()
+{
+    // found without locking after the first event of the thread. The tracers have
+    // unique ids, so an entry left by a destroyed tracer is never reused
+    thread_local std::unordered_map<uint64_t, Buffer*> buffers;
+    auto& b = buffers[id_];
+    if (!b) {
+        std::unique_lock<std::mutex> lk(mutex_);
+        buffers_.push_back(std::make_unique<Buffer>());
+        b = buffers_.back().get();
+    }
+    return *b;
+}
+
+void Tracer::record(const Event& e)
+{
+    auto& b = buffer();
+    std::unique_lock<std::mutex> lk(b.mutex);
+    if (e.kind == Kind::latency) {
+        if (b.stats.size() <= e.track)
+            b.stats.resize(e.track + 1);
+        auto& s = b.stats[e.track];
+        s.n++;
+        s.sum += e.dur;
+        s.max  = std::max(s.max, e.dur);
+    }
+    if (n_events_++ >= max_events_) {
+        n_events_--;
+        n_dropped_++;
+        return;
+    }
+    b.events.push_back(e);
+}
+
+std::map<std::string, Tracer::Latency> Tracer::latencies() const
+{
+    std::unique_lock<std::mutex> lk(mutex_);
+    std::vector<Stats> stats(tracks_.size());
+    for (auto& b: buffers_) {
+        std::unique_lock<std::mutex> buffer_lk(b->mutex);
+        for (std::size_t i = 0; i < b->stats.size() && i < stats.size(); ++i) {
+            stats[i].n   += b->stats[i].n;
+            stats[i].sum += b->stats[i].sum;
+            stats[i].max  = std::max(stats[i].max, b->stats[i].max);
+        }
+    }
+
+    std::map<std::string, Latency> ret;
+    for (std::size_t i = 0; i < tracks_.size(); ++i) {
+        auto& s = stats[i];
+        if (s.n)
+            ret[tracks_[i]] = {s.n, s.sum / static_cast<int64_t>(s.n), s.max};
+    }
+    return ret;
+}
+
+void Tracer::write_chrome_trace(const std::filesystem::path& filename) const
+{
+    std::unique_lock<std::mutex> lk(mutex_);
+
+    // merge the thread buffers in time order
+    std::vector<Event> events;
+    for (auto& b: buffers_) {
+        std::unique_lock<std::mutex> buffer_lk(b->mutex);
+        events.insert(events.end(), b->events.cbegin(), b->events.cend());
+    }
+    std::stable_sort(events.begin(), events.end(),
+                     [](const Event& a, const Event& b) {return a.ts < b.ts;});
+
+    std::ofstream os(filename);
+    os << "{\"displayTimeUnit\": \"ns\", \"traceEvents\": [\n";
+
+    // one thread per track, named after the filter or the link
+    for (std::size_t i = 0; i < tracks_.size(); ++i) {
+        os << (i ? ",\n" : "")
+           << "{\"ph\": \"M\", \"name\": \"thread_name\", \"pid\": 1, \"tid\": " << i
+           << ", \"args\": {\"name\": \"" << escape(tracks_[i]) << "\"}}";
+    }
+
+    for (auto& e: events) {
+        os << ",\n";
+        switch (e.kind) {
+        case Kind::activation:
+            os << "{\"ph\": \"X\", \"name\": \"activate\", \"cat\": \"compute\", \"pid\": 1, "
+               << "\"tid\": " << e.track << ", \"ts\": " << us(e.ts) << ", \"dur\": " << us(e.dur)
+               << "}";
+            break;
+        case Kind::wait:
+            os << "{\"ph\": \"X\", \"name\": \"queued\", \"cat\": \"queue\", \"pid\": 1, "
+               << "\"tid\": " << e.track << ", \"ts\": " << us(e.ts) << ", \"dur\": " << us(e.dur)
+               << ", \"args\": {\"trace_id\": " << e.trace_id << "}}";
+            break;
+        case Kind::latency:
+            // counter track (ms) of the latency since the newest & oldest frames
+            os << "{\"ph\": \"C\", \"name\": \"latency " << escape(tracks_[e.track])
+               << "\", \"pid\": 1, \"ts\": " << us(e.ts) << ", \"args\": {\"last frame\": "
+               << e.dur / 1e6 << ", \"first frame\": " << e.lat / 1e6 << "}}";
+            break;
+        }
+    }
+    os << "\n]}\n";
+}
+
+void Tracer::clear()
+{
+    std::unique_lock<std::mutex> lk(mutex_);
+    for (auto& b: buffers_) {
+        std::unique_lock<std::mutex> buffer_lk(b->mutex);
+        b->events.clear();
+        b->stats.clear();
+    }
+    n_events_  = 0;
+    n_dropped_ = 0;
+}
+
+} /* namespace dsp::trace */
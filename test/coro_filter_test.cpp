@@ -0,0 +1,132 @@
+#include <deque>
+
+#include "test_utils.h"
+
+#include "dsp/coro_filter.h"
+
+#include "spdlog/common.h"
+#include "spdlog/sinks/stdout_color_sinks.h"
+
+using T = arma::cx_double;
+
+/**
+ * Roll written as a coroutine, the output must match roll_filter_test.
+ */
+class CoroRoll: public CoroFilter
+{
+public:
+    CoroRoll(common::Logger logger, arma::uword skip):
+        CoroFilter(logger, "coro_roll"), skip_(skip)
+    {
+        Pad in  {.name = "in" , .format = Format()};
+        Pad out {.name = "out", .format = Format()};
+        input_pads_.insert({in.name, in});
+        output_pads_.insert({out.name, out});
+    }
+
+    Contract negotiate_format() override
+    {
+        auto fmt_in  = input_pads_["in"].format;
+        auto fmt_out = output_pads_["out"].format;
+        if (fmt_in.n_cols != fmt_out.n_cols || fmt_in.n_slices != fmt_out.n_slices ||
+            fmt_out.n_rows % fmt_in.n_rows != 0)
+            return Contract::unsupported_format;
+        return Contract::supported_format;
+    }
+
+    arma::uword retained_chunks(const std::string&) const override
+    {
+        return output_pads_.at("out").format.n_rows / input_pads_.at("in").format.n_rows;
+    }
+
+protected:
+    Task run() override
+    {
+        auto output = dynamic_cast<Link<T>*>(outputs_.at("out"));
+        const auto fmt_in  = inputs_.at("in")->format();
+        const auto fmt_out = output->format();
+        const arma::uword n = fmt_out.n_rows / fmt_in.n_rows;
+
+        std::deque<typename Link<T>::const_elem_type> queue;
+        // first filling of the queue
+        while (queue.size() < n - 1) {
+            auto chunk = co_await pop<T>("in");
+            if (!chunk) {
+                output->eof_reached();
+                co_return;
+            }
+            queue.push_back(chunk);
+        }
+
+        for (arma::uword i = 0;; ++i) {
+            auto chunk = co_await pop<T>("in");
+            if (!chunk)
+                break;
+            queue.push_back(chunk);
+
+            if (i % skip_ == 0) {
+                auto chunk_out = output->make_chunk(queue.front()->header);
+                for (arma::uword k = 0; k < n; ++k)
+                    chunk_out->rows(k * fmt_in.n_rows, (k+1) * fmt_in.n_rows - 1) = *queue[k];
+                output->push(chunk_out);
+            }
+            queue.pop_front();
+        }
+        output->eof_reached();
+    }
+
+private:
+    arma::uword skip_;
+};
+
+int main(int argc, char * argv[])
+{
+    if (argc != 4)
+        return -1;
+
+    std::string filename_in(argv[1]);
+    std::string filename_out(argv[2]);
+    std::string filename_params(argv[3]);
+
+    common::Logger logger(spdlog::stdout_color_mt("dsp"));
+    logger->set_level(spdlog::level::info);
+
+    Pipeline pipeline(logger);
+
+    cnpy::NpyArray nskip_np   = cnpy::npz_load(filename_params, "nskip");
+    cnpy::NpyArray n_in_np    = cnpy::npz_load(filename_params, "n_in");
+    cnpy::NpyArray n_out_np   = cnpy::npz_load(filename_params, "n_out");
+
+    arma::uword nskip(*nskip_np.data<arma::uword>());
+    arma::uword n_in(*n_in_np.data<arma::uword>());
+    arma::uword n_out(*n_out_np.data<arma::uword>());
+
+    auto source_filter = std::make_unique<NpySource<T>>(logger, filename_in, Period::ms(1));
+    auto fmt_data = source_filter->get_fmt();
+    auto source_h = pipeline.add_filter(std::move(source_filter));
+
+    auto roll_h = pipeline.add_filter(std::make_unique<CoroRoll>(logger, nskip));
+
+    auto sink_filter = std::make_unique<NpySink<T>>(logger, fmt_data);
+    auto sink_p = sink_filter.get();
+    auto sink_h = pipeline.add_filter(std::move(sink_filter));
+
+    pipeline.link<T>(source_h, "out", roll_h, "in");
+    pipeline.link<T>(roll_h, "out", sink_h, "in");
+
+    Format fmt_in  { n_in, fmt_data.n_cols, fmt_data.n_slices };
+    Format fmt_out { n_out, fmt_in.n_cols, fmt_in.n_slices };
+    source_h->set_output_format(fmt_in, "out");
+    roll_h->set_input_format(fmt_in, "in");
+    roll_h->set_output_format(fmt_out, "out");
+    sink_h->set_input_format(fmt_out, "in");
+    if (pipeline.negotiate_format() != Contract::supported_format)
+        throw dsp_error(Errc::format_negotiation_failed);
+
+    sink_p->dump(filename_out);
+
+    std::cout << "frame arena blocks: " << pipeline.frame_arena().n_blocks() << "\n";
+    pipeline.print_stats();
+
+    return 0;
+}
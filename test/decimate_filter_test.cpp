@@ -0,0 +1,70 @@
+#include "test_utils.h"
+
+#include "dsp/decimate_filter.h"
+
+#include "spdlog/common.h"
+#include "spdlog/sinks/stdout_color_sinks.h"
+
+using T = arma::cx_double;
+
+int main(int argc, char * argv[])
+{
+    if (argc != 4)
+        return -1;
+
+    std::string filename_in(argv[1]);
+    std::string filename_out(argv[2]);
+    std::string filename_params(argv[3]);
+
+    cnpy::NpyArray nskip_np  = cnpy::npz_load(filename_params, "nskip");
+    cnpy::NpyArray factor_np = cnpy::npz_load(filename_params, "factor");
+    cnpy::NpyArray taps_np   = cnpy::npz_load(filename_params, "taps");
+
+    arma::uword nskip(*nskip_np.data<arma::uword>());
+    arma::uword factor(*factor_np.data<arma::uword>());
+    arma::vec   taps(taps_np.data<double>(), taps_np.shape.at(0));
+
+    common::Logger logger(spdlog::stdout_color_mt("dsp"));
+    logger->set_level(spdlog::level::info);
+
+    Pipeline pipeline(logger);
+
+    auto source_filter = std::make_unique<NpySource<T>>(logger, filename_in, Period::ms(1));
+    auto fmt_data = source_filter->get_fmt();
+    auto source_h = pipeline.add_filter(std::move(source_filter));
+
+    auto decimate_filter = std::make_unique<filter::Decimate<T>>(logger, factor, taps);
+    auto decimate_h = pipeline.add_filter(std::move(decimate_filter));
+
+    auto sink_filter = std::make_unique<NpySink<T>>(logger, fmt_data);
+    auto sink_p = sink_filter.get();
+    auto sink_h = pipeline.add_filter(std::move(sink_filter));
+
+    pipeline.link<T>(source_h, "out", decimate_h, "in");
+    pipeline.link<T>(decimate_h, "out", sink_h, "in");
+
+    Format fmt_in  { nskip * factor, fmt_data.n_cols, fmt_data.n_slices };
+    Format fmt_out { nskip, fmt_in.n_cols, fmt_in.n_slices };
+    source_h->set_output_format(fmt_in, "out");
+    decimate_h->set_input_format(fmt_in, "in");
+    decimate_h->set_output_format(fmt_out, "out");
+    sink_h->set_input_format(fmt_out, "in");
+    if (pipeline.negotiate_format() != Contract::supported_format)
+        throw dsp_error(Errc::format_negotiation_failed);
+
+    std::cout << "Input:\n"
+              << "  type: " << typeid(T).name() << "\n"
+              << "  chunk size: (" << fmt_in.n_rows << "," << fmt_in.n_cols << "," << fmt_in.n_slices << ")\n"
+              << "  nb frames total: " << fmt_data.n_rows << "\n"
+              << "------------------------------\n"
+              << "Filter params:\n"
+              << "  factor: " << factor << "\n"
+              << "  taps: "; taps.t().print();
+    std::cout << "------------------------------\n";
+
+    sink_p->dump(filename_out);
+
+    pipeline.print_stats();
+
+    return 0;
+}
@@ -0,0 +1,212 @@
+#include <iostream>
+
+#include "test_utils.h"
+
+#include "dsp/iir_filter.h"
+#include "dsp/roll_filter.h"
+#include "dsp/fhr_filter.h"
+#include "dsp/tee_filter.h"
+
+#include "spdlog/common.h"
+#include "spdlog/sinks/stdout_color_sinks.h"
+
+using T = double;
+
+/**
+ * Keeps the chunks it receives.
+ */
+class Recorder: public Filter
+{
+public:
+    Recorder(common::Logger logger, std::string_view name): Filter(logger, name)
+    {
+        Pad p {.name="in", .format=Format()};
+        input_pads_.insert({p.name, p});
+    }
+
+    int activate() override
+    {
+        auto input = dynamic_cast<Link<T>*>(inputs_.at("in"));
+        typename Link<T>::const_elem_type chunk;
+        int ret = 0;
+        while (input->pop(chunk)) {
+            headers.push_back(chunk->header);
+            data.push_back(*chunk);
+            ret = 1;
+        }
+        return ret;
+    }
+
+    void reset() override {headers.clear(); data.clear();}
+
+    Contract negotiate_format() override {return Contract::supported_format;}
+
+    bool ended() const {return inputs_.at("in")->eof() && inputs_.at("in")->empty();}
+
+    std::vector<ChunkHeader>   headers;
+    std::vector<arma::Cube<T>> data;
+};
+
+static std::string frame(int16_t level)
+{
+    const int16_t x[2] = {level, static_cast<int16_t>(-level)};
+    return std::string(reinterpret_cast<const char*>(x), sizeof(x));
+}
+
+int main()
+{
+    common::Logger logger(spdlog::stdout_color_mt("dsp"));
+    logger->set_level(spdlog::level::err);
+
+    Pipeline pipeline(logger);
+
+    auto source_filter = std::make_unique<filter::Source<int16_t, T>>(logger);
+    auto source = source_filter.get();
+    pipeline.add_filter(std::move(source_filter));
+
+    auto tee = pipeline.add_filter(std::make_unique<filter::Tee<T, 4>>(logger));
+
+    auto iir_filter = std::make_unique<filter::IIR<T, T>>(logger, "iir", arma::vec {0.5},
+                                                            arma::vec {1, -0.5});
+    iir_filter->set_warm_up(64);
+    auto iir = pipeline.add_filter(std::move(iir_filter));
+
+    auto roll = pipeline.add_filter(std::make_unique<filter::Roll<T>>(logger, 1));
+
+    auto fhr_filter = std::make_unique<filter::FHR<T, T, T>>(logger, 1, 3, 0.5);
+    auto fhr = fhr_filter.get();
+    pipeline.add_filter(std::move(fhr_filter));
+
+    std::map<std::string, Recorder*> rec;
+    for (auto name: {"raw", "iir_out", "roll_out", "fhr_out", "cor_out"}) {
+        auto r = std::make_unique<Recorder>(logger, name);
+        rec[name] = r.get();
+        pipeline.add_filter(std::move(r));
+    }
+
+    pipeline.link<T>(source, "out", tee, "in");
+    pipeline.link<T>(tee, "0", rec["raw"], "in");
+    pipeline.link<T>(tee, "1", iir, "in");
+    pipeline.link<T>(tee, "2", roll, "in");
+    pipeline.link<T>(tee, "3", fhr, "in");
+    pipeline.link<T>(iir, "out", rec["iir_out"], "in");
+    pipeline.link<T>(roll, "out", rec["roll_out"], "in");
+    pipeline.link<T>(fhr, "fhr", rec["fhr_out"], "in");
+    pipeline.link<T>(fhr, "cor", rec["cor_out"], "in");
+
+    // 4 frames per chunk, 2 per output of roll
+    source->set_output_format({4, 2, 1}, "out");
+    roll->set_output_format({8, 0, 0}, "out");
+    if (pipeline.negotiate_format() != Contract::supported_format)
+        throw dsp_error(Errc::format_negotiation_failed);
+
+    // the level changes at each gap, a filter carrying its state over the gap rings
+    //   chunk 0: 0-3 ms
+    //   chunk 1: 4-5 ms, gap, 9-10 ms     -> invalid
+    //   chunk 2: 11-14 ms                 -> discontinuity
+    //   chunk 3: 15-18 ms, wrong size     -> invalid
+    //   chunk 4: 19-22 ms                 -> discontinuity
+    //   chunk 5: 23-26 ms
+    //   chunk 6: gap, 40-43 ms            -> discontinuity
+    //   chunk 7: 44-47 ms
+    auto level = [](uint32_t ts) -> int16_t {
+        return ts < 6 ? 100 : ts < 15 ? -100 : ts < 19 ? 30 : ts < 40 ? 60 : -20;
+    };
+    std::vector<uint32_t> timestamps;
+    for (uint32_t ts = 0; ts < 48; ++ts)
+        if (ts < 6 || ts > 8) {
+            if (ts < 27 || ts > 39)
+                timestamps.push_back(ts);
+        }
+    for (auto ts: timestamps)
+        source->push_frame(ts == 16 ? std::string(3, 0) : frame(level(ts)), ts);
+    source->eof();
+
+    for (int i = 0; i < 100 && !(rec["raw"]->ended() && rec["iir_out"]->ended() &&
+                                 rec["roll_out"]->ended() && rec["fhr_out"]->ended()); ++i) {
+        for (auto& [name, r]: rec)
+            r->activate();
+        pipeline.run();
+    }
+
+    // flags set by the source
+    const std::vector<uint32_t> flags {0, chunk_flag::invalid, chunk_flag::discontinuity,
+                                       chunk_flag::invalid, chunk_flag::discontinuity, 0,
+                                       chunk_flag::discontinuity, 0};
+    auto& raw = rec["raw"]->headers;
+    if (raw.size() != flags.size()) {
+        std::cerr << raw.size() << " chunks instead of " << flags.size() << "\n";
+        return 1;
+    }
+    for (std::size_t i = 0; i < flags.size(); ++i) {
+        if (raw[i].flags != flags[i]) {
+            std::cerr << "chunk " << i << ": flags " << raw[i].flags << " instead of "
+                      << flags[i] << "\n";
+            return 1;
+        }
+    }
+    if (source->n_invalid_frames() != 1) {
+        std::cerr << source->n_invalid_frames() << " invalid frames\n";
+        return 1;
+    }
+
+    auto counters = pipeline.link_counters();
+    auto& c = counters.at("source.out -> tee.in");
+    if (c.n_chunks != 8 || c.n_invalid != 2 || c.n_discontinuities != 3) {
+        std::cerr << "source link: " << c.n_chunks << " chunks, " << c.n_invalid
+                  << " invalid, " << c.n_discontinuities << " discontinuities\n";
+        return 1;
+    }
+
+    // the iir restarts settled on the first sample after each gap: the valid chunks
+    // (after the initial transient) are the constant levels, without ringing
+    auto& iir_out = rec["iir_out"]->data;
+    auto& raw_data = rec["raw"]->data;
+    for (std::size_t i = 1; i < flags.size(); ++i) {
+        if (flags[i] & chunk_flag::invalid)
+            continue;
+        if (!arma::approx_equal(iir_out[i], raw_data[i], "absdiff", 1e-9)) {
+            std::cerr << "iir rings after chunk " << i << "\n";
+            return 1;
+        }
+    }
+
+    // roll flushes at each gap & drops the invalid chunks: only chunks 4-5 & 6-7
+    // make outputs, both discontinuous
+    auto& roll_out = rec["roll_out"];
+    auto rolled = [&](std::size_t i, std::size_t first) {
+        auto& out = roll_out->data[i];
+        return arma::approx_equal(out.rows(0, 3), raw_data[first], "absdiff", 0) &&
+               arma::approx_equal(out.rows(4, 7), raw_data[first + 1], "absdiff", 0);
+    };
+    if (roll_out->headers.size() != 2 ||
+        roll_out->headers[0].timestamp != raw[4].timestamp ||
+        roll_out->headers[1].timestamp != raw[6].timestamp ||
+        !roll_out->headers[0].has(chunk_flag::discontinuity) ||
+        !roll_out->headers[1].has(chunk_flag::discontinuity) ||
+        !rolled(0, 4) || !rolled(1, 6)) {
+        std::cerr << "roll: " << roll_out->headers.size() << " outputs\n";
+        return 1;
+    }
+    // chunks 0, 2 & 5 flushed, 1 & 3 invalid
+    if (counters.at("tee.2 -> roll.in").n_dropped != 5) {
+        std::cerr << "roll: " << counters.at("tee.2 -> roll.in").n_dropped << " dropped\n";
+        return 1;
+    }
+
+    // fhr skips the invalid windows
+    auto& fhr_out = rec["fhr_out"];
+    if (fhr->n_skipped() != 2 || fhr_out->headers.size() != flags.size()) {
+        std::cerr << "fhr: " << fhr->n_skipped() << " skipped\n";
+        return 1;
+    }
+    for (std::size_t i: {1, 3}) {
+        if (!fhr_out->headers[i].has(chunk_flag::invalid) ||
+            arma::any(arma::vectorise(fhr_out->data[i]))) {
+            std::cerr << "fhr: invalid window " << i << " not skipped\n";
+            return 1;
+        }
+    }
+
+    return 0;
+}
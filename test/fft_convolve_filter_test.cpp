@@ -0,0 +1,69 @@
+#include "test_utils.h"
+
+#include "dsp/fft_convolve_filter.h"
+
+#include "spdlog/common.h"
+#include "spdlog/sinks/stdout_color_sinks.h"
+
+using T = arma::cx_double;
+
+int main(int argc, char * argv[])
+{
+    if (argc != 4)
+        return -1;
+
+    std::string filename_in(argv[1]);
+    std::string filename_out(argv[2]);
+    std::string filename_params(argv[3]);
+
+    cnpy::NpyArray nskip_np  = cnpy::npz_load(filename_params, "nskip");
+    cnpy::NpyArray block_np  = cnpy::npz_load(filename_params, "block_size");
+    cnpy::NpyArray taps_np   = cnpy::npz_load(filename_params, "taps");
+
+    arma::uword nskip(*nskip_np.data<arma::uword>());
+    arma::uword block_size(*block_np.data<arma::uword>());
+    arma::vec   taps(taps_np.data<double>(), taps_np.shape.at(0));
+
+    common::Logger logger(spdlog::stdout_color_mt("dsp"));
+    logger->set_level(spdlog::level::info);
+
+    Pipeline pipeline(logger);
+
+    auto source_filter = std::make_unique<NpySource<T>>(logger, filename_in, Period::ms(1));
+    auto fmt_data = source_filter->get_fmt();
+    auto source_h = pipeline.add_filter(std::move(source_filter));
+
+    auto convolve_filter = std::make_unique<filter::FFTConvolve<T>>(logger, taps, block_size);
+    auto convolve_h = pipeline.add_filter(std::move(convolve_filter));
+
+    auto sink_filter = std::make_unique<NpySink<T>>(logger, fmt_data);
+    auto sink_p = sink_filter.get();
+    auto sink_h = pipeline.add_filter(std::move(sink_filter));
+
+    pipeline.link<T>(source_h, "out", convolve_h, "in");
+    pipeline.link<T>(convolve_h, "out", sink_h, "in");
+
+    Format fmt { nskip, fmt_data.n_cols, fmt_data.n_slices };
+    source_h->set_output_format(fmt, "out");
+    convolve_h->set_input_format(fmt, "in");
+    convolve_h->set_output_format(fmt, "out");
+    sink_h->set_input_format(fmt, "in");
+    if (pipeline.negotiate_format() != Contract::supported_format)
+        throw dsp_error(Errc::format_negotiation_failed);
+
+    std::cout << "Input:\n"
+              << "  type: " << typeid(T).name() << "\n"
+              << "  chunk size: (" << fmt.n_rows << "," << fmt.n_cols << "," << fmt.n_slices << ")\n"
+              << "  nb frames total: " << fmt_data.n_rows << "\n"
+              << "------------------------------\n"
+              << "Filter params:\n"
+              << "  block size: " << block_size << "\n"
+              << "  n taps:     " << taps.n_elem << "\n";
+    std::cout << "------------------------------\n";
+
+    sink_p->dump(filename_out);
+
+    pipeline.print_stats();
+
+    return 0;
+}
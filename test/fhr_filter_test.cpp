@@ -31,7 +31,7 @@ int main(int argc, char * argv[])
 
     Pipeline pipeline(logger);
 
-    auto source_filter = std::make_unique<NpySource<T>>(logger, filename_in, 1);
+    auto source_filter = std::make_unique<NpySource<T>>(logger, filename_in, Period::ms(1));
     auto fmt_data = source_filter->get_fmt();
     auto source_h = pipeline.add_filter(std::move(source_filter));
 
@@ -0,0 +1,194 @@
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <vector>
+
+#include <mlpack/core.hpp>
+#include <mlpack/methods/random_forest/random_forest.hpp>
+#include <mlpack/methods/decision_tree/random_dimension_select.hpp>
+
+#include "dsp/forest.h"
+
+using namespace mlpack::tree;
+using dsp::FlatForest;
+
+using Forest = RandomForest<GiniGain, RandomDimensionSelect>;
+namespace fs = std::filesystem;
+
+static std::vector<char> read_file(const fs::path& p)
+{
+    std::ifstream is(p, std::ios::binary);
+    return std::vector<char>(std::istreambuf_iterator<char>(is), {});
+}
+
+static void write_file(const fs::path& p, const std::vector<char>& data)
+{
+    std::ofstream os(p, std::ios::binary | std::ios::trunc);
+    os.write(data.data(), data.size());
+}
+
+static arma::mat predict(const FlatForest& f, const arma::mat& x)
+{
+    arma::mat probs(f.n_classes(), x.n_cols);
+    f.predict(x.memptr(), x.n_rows, x.n_cols, probs.memptr(), 0, f.n_classes());
+    return probs;
+}
+
+// the probabilities must match mlpack's (up to the rounding of the average)
+static bool same_probs(const Forest& rf, const FlatForest& f, const arma::mat& x,
+                       const char * what)
+{
+    arma::Row<size_t> predictions;
+    arma::mat expected;
+    rf.Classify(x, predictions, expected);
+    if (!arma::approx_equal(predict(f, x), expected, "absdiff", 1e-12)) {
+        std::cerr << what << ": probabilities differ from RandomForest::Classify\n";
+        return false;
+    }
+    return true;
+}
+
+// the load must fail with invalid_model
+static bool rejected(const fs::path& p)
+{
+    try {
+        FlatForest::load(p);
+    } catch (dsp::dsp_error&) {
+        return true;
+    }
+    return false;
+}
+
+// offsets of the tables in a saved model (see the Layout in forest.cpp)
+struct Offsets
+{
+    size_t n_features = 16, n_nodes = 24, n_leaves = 32;
+    size_t feature, child, leaf;
+
+    explicit Offsets(const std::vector<char>& data)
+    {
+        auto aligned = [](size_t n) {return (n + 7) & ~size_t(7);};
+        uint32_t n_trees;
+        uint64_t n;
+        std::memcpy(&n_trees, data.data() + 20, sizeof(n_trees));
+        std::memcpy(&n, data.data() + n_nodes, sizeof(n));
+        const size_t roots  = aligned(48);
+        const size_t depths = aligned(roots + n_trees * sizeof(uint32_t));
+        feature = aligned(depths  + n_trees * sizeof(uint32_t));
+        child   = aligned(feature + n * sizeof(uint32_t));
+        leaf    = aligned(child   + n * sizeof(uint32_t));
+    }
+};
+
+int main()
+{
+    arma::arma_rng::set_seed(0);
+    mlpack::math::RandomSeed(0);
+
+    // 3 classes split on the first two features, the third one is noise
+    const arma::uword n_samples = 600;
+    arma::mat x(3, n_samples, arma::fill::randu);
+    arma::Row<size_t> y(n_samples);
+    for (arma::uword i = 0; i < n_samples; ++i)
+        y[i] = x(0, i) < 0.3 ? 0 : (x(1, i) < 0.6 ? 1 : 2);
+
+    const fs::path dir = fs::temp_directory_path() / "dsp_forest_test";
+    fs::remove_all(dir);
+    fs::create_directories(dir);
+    const fs::path model = dir / "model.dspf";
+
+    Forest rf(x, y, 3, 8, 5);
+    auto f = FlatForest::compile(rf);
+    const arma::mat expected = predict(f, x);
+    if (!same_probs(rf, f, x, "training set") ||
+        !same_probs(rf, f, arma::mat(3, 200, arma::fill::randu), "test set"))
+        return 1;
+
+    // integer features: mlpack splits halfway between consecutive values, the test
+    // points on the half integers fall exactly on the split values
+    arma::mat xi = arma::floor(x * 10);
+    Forest rfi(xi, y, 3, 8, 5);
+    arma::mat ties = arma::floor(arma::mat(3, 500, arma::fill::randu) * 10) + 0.5;
+    if (!same_probs(rfi, FlatForest::compile(rfi), ties, "ties"))
+        return 1;
+
+    // the leaves can't be split: each tree is a single leaf
+    Forest rf1(x, y, 3, 4, n_samples);
+    auto f1 = FlatForest::compile(rf1);
+    if (f1.n_nodes() != f1.n_trees()) {
+        std::cerr << "single leaf: " << f1.n_nodes() << " nodes for " << f1.n_trees() << " trees\n";
+        return 1;
+    }
+    if (!same_probs(rf1, f1, x, "single leaf"))
+        return 1;
+
+    // round trip
+    f.save(model);
+    auto g = FlatForest::load(model);
+    if (g.n_trees() != f.n_trees() || g.n_nodes() != f.n_nodes() ||
+        g.n_classes() != f.n_classes() || g.n_features() != f.n_features()) {
+        std::cerr << "loaded model differs from the saved one\n";
+        return 1;
+    }
+    if (!arma::approx_equal(predict(g, x), expected, "absdiff", 0)) {
+        std::cerr << "predictions differ after the round trip\n";
+        return 1;
+    }
+
+    // saving over a mapped model doesn't change the forests already loaded
+    Forest rf2(x, y, 3, 2, 50);
+    FlatForest::compile(rf2).save(model);
+    if (!arma::approx_equal(predict(g, x), expected, "absdiff", 0)) {
+        std::cerr << "mapped model modified by save\n";
+        return 1;
+    }
+    if (FlatForest::load(model).n_trees() != 2) {
+        std::cerr << "new model not loaded\n";
+        return 1;
+    }
+    f.save(model);
+
+    const std::vector<char> data = read_file(model);
+    const Offsets off(data);
+    uint32_t n_features;
+    uint64_t n_nodes, n_leaves;
+    std::memcpy(&n_features, data.data() + off.n_features, sizeof(n_features));
+    std::memcpy(&n_nodes, data.data() + off.n_nodes, sizeof(n_nodes));
+    std::memcpy(&n_leaves, data.data() + off.n_leaves, sizeof(n_leaves));
+
+    // truncated file
+    write_file(dir / "truncated.dspf", std::vector<char>(data.begin(), data.end() - 8));
+    if (!rejected(dir / "truncated.dspf")) {
+        std::cerr << "truncated model accepted\n";
+        return 1;
+    }
+
+    // out of range indices of the root of the first tree
+    auto corrupt = [&](const char * name, size_t offset, uint32_t value) {
+        auto bad = data;
+        std::memcpy(bad.data() + offset, &value, sizeof(value));
+        write_file(dir / name, bad);
+        return rejected(dir / name);
+    };
+    if (!corrupt("feature.dspf", off.feature, n_features)) {
+        std::cerr << "out of range feature accepted\n";
+        return 1;
+    }
+    if (!corrupt("child.dspf", off.child, n_nodes)) {
+        std::cerr << "out of range node accepted\n";
+        return 1;
+    }
+    if (!corrupt("sibling.dspf", off.child, n_nodes - 1)) {
+        std::cerr << "out of range right child accepted\n";
+        return 1;
+    }
+    if (!corrupt("leaf.dspf", off.leaf, n_leaves)) {
+        std::cerr << "out of range leaf accepted\n";
+        return 1;
+    }
+
+    fs::remove_all(dir);
+    return 0;
+}
@@ -1,10 +1,6 @@
 #include "test_utils.h"
 
-#include "dsp/iir_filter.h"
-#include "dsp/roll_filter.h"
-#include "dsp/buffer_filter.h"
-#include "dsp/fd_filter.h"
-#include "dsp/fhr_filter.h"
+#include "dsp/graph.h"
 
 #include "spdlog/sinks/stdout_color_sinks.h"
 
@@ -13,12 +9,23 @@ using T_fd = double;
 
 int main(int argc, char * argv[])
 {
-    if (argc != 4)
+    if (argc < 4 || argc > 6)
         return -1;
 
     std::string filename_in(argv[1]);
     std::string filename_out(argv[2]);
     std::string filename_params(argv[3]);
+    // optional batch size, the outputs must be identical to the streaming mode (1)
+    arma::uword batch_size = argc >= 5 ? std::stoul(argv[4]) : 1;
+    // optional: run the iq & fd subgraphs in their own execution domain ("domains"),
+    // store the chunks in huge pages ("huge"), throttle the source with a tiny
+    // memory budget ("budget", the outputs must not change) or record a trace
+    // ("trace")
+    std::string mode = argc == 6 ? argv[5] : "";
+    bool domains = mode == "domains";
+    bool huge    = mode == "huge";
+    bool budget  = mode == "budget";
+    bool tracing = mode == "trace";
 
     cnpy::NpyArray a1_np         = cnpy::npz_load(filename_params, "a1");
     cnpy::NpyArray b1_np         = cnpy::npz_load(filename_params, "b1");
@@ -48,83 +55,82 @@ int main(int argc, char * argv[])
     common::Logger logger(spdlog::stdout_color_mt("dsp"));
     logger->set_level(spdlog::level::info);
 
-    Pipeline pipeline(logger);
-
-    auto source_filter = std::make_unique<NpySource<T_iq>>(logger, filename_in, 1);
+    auto source_filter = std::make_unique<NpySource<T_iq>>(logger, filename_in, Period::ms(1), "source");
     auto fmt_data = source_filter->get_fmt();
-    auto source_h = pipeline.add_filter(std::move(source_filter));
-
-    auto iir_filter_iq = std::make_unique<filter::IIR<T_iq, double>>(logger, "iir_iq", b1, a1);
-    auto iir_iq_h = pipeline.add_filter(std::move(iir_filter_iq));
-
-    auto roll_filter_iq = std::make_unique<filter::Roll<T_iq>>(logger, "roll_iq", 1);
-    auto roll_iq_h = pipeline.add_filter(std::move(roll_filter_iq));
-
-    auto fd_filter = std::make_unique<filter::FD<T_iq, T_fd>>(logger, nfft, arma::vec(nfft, arma::fill::ones));
-    auto fd_h = pipeline.add_filter(std::move(fd_filter));
-
-    auto buffer_filter = std::make_unique<filter::Buffer<T_fd>>(logger);
-    auto buffer_h = pipeline.add_filter(std::move(buffer_filter));
-
-    auto iir_filter_fd = std::make_unique<filter::IIR<T_fd, double>>(logger, "iir_fd", b2, a2);
-    auto iir_fd_h = pipeline.add_filter(std::move(iir_filter_fd));
-
-    auto roll_fd_filter = std::make_unique<filter::Roll<T_fd>>(logger, "roll_fd", 1);
-    auto roll_fd_h = pipeline.add_filter(std::move(roll_fd_filter));
-
-    auto fhr_filter = std::make_unique<filter::FHR<T_fd, T_fd, T_fd>>(logger, radius, period_max, threshold);
-    auto fhr_h = pipeline.add_filter(std::move(fhr_filter));
-
-    auto sink_filter_0 = std::make_unique<NpySink<T_fd>>(logger, fmt_data, "sink_fhr");
-    auto sink_p0 = sink_filter_0.get();
-    auto sink0_h = pipeline.add_filter(std::move(sink_filter_0));
-
-    auto sink_filter_1 = std::make_unique<NpySink<T_fd>>(logger, fmt_data, "sink_cor");
-    auto sink_p1 = sink_filter_1.get();
-    auto sink1_h = pipeline.add_filter(std::move(sink_filter_1));
-
-    pipeline.link<T_iq>(source_h , "out", iir_iq_h , "in");
-    pipeline.link<T_iq>(iir_iq_h , "out", roll_iq_h, "in");
-    pipeline.link<T_iq>(roll_iq_h, "out", fd_h     , "in");
-    pipeline.link<T_fd>(fd_h     , "out", buffer_h , "in");
-    pipeline.link<T_fd>(buffer_h , "out", iir_fd_h , "in");
-    pipeline.link<T_fd>(iir_fd_h , "out", roll_fd_h, "in");
-    pipeline.link<T_fd>(roll_fd_h, "out", fhr_h    , "in");
-    pipeline.link<T_fd>(fhr_h    , "fhr", sink0_h  , "in");
-    pipeline.link<T_fd>(fhr_h    , "cor", sink1_h  , "in");
-
-    Format fmt_in      { nskip   , fmt_data.n_cols, fmt_data.n_slices };
-    Format fmt_roll_iq { nfft    , fmt_in.n_cols, fmt_in.n_slices };
-    Format fmt_fd      { 1       , fmt_in.n_cols, fmt_in.n_slices };
-    Format fmt_buffer  { fdskip  , fmt_in.n_cols, fmt_in.n_slices };
-    Format fmt_roll_fd { fdperseg, fmt_in.n_cols, fmt_in.n_slices };
-    Format fmt_out     { 1       , fmt_in.n_cols, fmt_in.n_slices };
-
-    source_h->set_output_format(fmt_in, "out");
-    iir_iq_h->set_input_format(fmt_in, "in");
-    iir_iq_h->set_output_format(fmt_in, "out");
-    roll_iq_h->set_input_format(fmt_in, "in");
-    roll_iq_h->set_output_format(fmt_roll_iq, "out");
-    fd_h->set_input_format(fmt_roll_iq, "in");
-    fd_h->set_output_format(fmt_fd, "out");
-    buffer_h->set_input_format(fmt_fd, "in");
-    buffer_h->set_output_format(fmt_buffer, "out");
-    iir_fd_h->set_input_format(fmt_buffer, "in");
-    iir_fd_h->set_output_format(fmt_buffer, "out");
-    roll_fd_h->set_input_format(fmt_buffer, "in");
-    roll_fd_h->set_output_format(fmt_roll_fd, "out");
-    fhr_h->set_input_format(fmt_roll_fd, "in");
-    fhr_h->set_output_format(fmt_out, "fhr");
-    fhr_h->set_output_format(fmt_out, "cor");
-    sink0_h->set_input_format(fmt_out, "in");
-    sink1_h->set_input_format(fmt_out, "in");
-    if (pipeline.negotiate_format() != Contract::supported_format)
-        throw dsp_error(Errc::format_negotiation_failed);
+
+    Format fmt_in { nskip, fmt_data.n_cols, fmt_data.n_slices };
+
+    // the source is already loaded, it's only instantiated once
+    Graph graph;
+    graph.add("source", [&source_filter](common::Logger, const std::string&) {
+            return std::move(source_filter);
+        })
+        .add("iir_iq"  , "iir<cx_double>" , {{"b", b1}, {"a", a1}})
+        .add("roll_iq" , "roll<cx_double>", {{"skip", 1}})
+        .add("fd"      , "fd<cx_double>"  , {{"nfft", nfft}})
+        .add("buffer"  , "buffer<double>")
+        .add("iir_fd"  , "iir<double>"    , {{"b", b2}, {"a", a2}})
+        .add("roll_fd" , "roll<double>"   , {{"skip", 1}})
+        .add("fhr"     , "fhr<double>"    , {{"radius", radius}, {"period_max", period_max},
+                                             {"threshold", threshold}})
+        .add("sink_fhr", [&fmt_data](common::Logger l, const std::string& name) {
+            return std::make_unique<NpySink<T_fd>>(l, fmt_data, name);
+        })
+        .add("sink_cor", [&fmt_data](common::Logger l, const std::string& name) {
+            return std::make_unique<NpySink<T_fd>>(l, fmt_data, name);
+        });
+
+    graph.link<T_iq>("source" , "out", "iir_iq"  , "in")
+        .link<T_iq>("iir_iq"  , "out", "roll_iq" , "in")
+        .link<T_iq>("roll_iq" , "out", "fd"      , "in")
+        .link<T_fd>("fd"      , "out", "buffer"  , "in")
+        .link<T_fd>("buffer"  , "out", "iir_fd"  , "in")
+        .link<T_fd>("iir_fd"  , "out", "roll_fd" , "in")
+        .link<T_fd>("roll_fd" , "out", "fhr"     , "in")
+        .link<T_fd>("fhr"     , "fhr", "sink_fhr", "in")
+        .link<T_fd>("fhr"     , "cor", "sink_cor", "in");
+
+    // the other formats are derived during the negotiation
+    graph.set_format("source" , "out", fmt_in)
+        .set_format("roll_iq" , "out", {nfft, 0, 0})
+        .set_format("buffer"  , "out", {fdskip, 0, 0})
+        .set_format("roll_fd" , "out", {fdperseg, 0, 0});
+
+    auto pipeline = graph.instantiate(logger);
+    pipeline->set_batch_size(batch_size);
+    if (huge) {
+        pipeline->set_huge_pages(true);
+        if (pipeline->negotiate_format() != Contract::supported_format)
+            throw dsp_error(Errc::format_negotiation_failed);
+    }
+    if (budget)
+        pipeline->set_memory_budget(1, Pipeline::MemoryPolicy::backpressure);
+    pipeline->set_tracing(tracing);
+    pipeline->set_profiling(true);
+    auto sink_p0 = dynamic_cast<NpySink<T_fd>*>(pipeline->get_filter("sink_fhr"));
+    auto sink_p1 = dynamic_cast<NpySink<T_fd>*>(pipeline->get_filter("sink_cor"));
+
+    if (domains) {
+        auto filters = [&pipeline](std::initializer_list<std::string> names) {
+            std::vector<Filter*> v;
+            for (auto& n: names)
+                v.push_back(pipeline->get_filter(n));
+            return v;
+        };
+        pipeline->add_domain("iq", {});
+        pipeline->add_domain("fd", {});
+        pipeline->assign(filters({"iir_iq", "roll_iq", "fd"}), "iq");
+        pipeline->assign(filters({"buffer", "iir_fd", "roll_fd", "fhr"}), "fd");
+        pipeline->start_domains();
+    }
 
     std::cout << "Input:\n"
               << "  type: " << typeid(T_iq).name() << "\n"
               << "  chunk size: (" << fmt_in.n_rows << "," << fmt_in.n_cols << "," << fmt_in.n_slices << ")\n"
               << "  nb frames total: " << fmt_data.n_rows << "\n"
+              << "  batch size: " << batch_size << "\n"
+              << "  domains: " << (domains ? "iq, fd" : "none") << "\n"
+              << "  huge pages: " << (huge ? "yes" : "no") << "\n"
               << "------------------------------\n"
               << "Filters params:\n"
               << "  nfft:       " << nfft << "\n"
@@ -142,8 +148,11 @@ int main(int argc, char * argv[])
 
     sink_p0->dump("fhr_" + filename_out);
     sink_p1->dump("corr_" + filename_out);
+    pipeline->stop_domains();
+    if (tracing)
+        pipeline->tracer().write_chrome_trace("trace_" + filename_out + ".json");
 
-    pipeline.print_stats();
+    pipeline->print_stats();
 
     return 0;
 }
@@ -0,0 +1,209 @@
+#include <iostream>
+
+#include "test_utils.h"
+
+#include "dsp/join_filter.h"
+
+#include "spdlog/common.h"
+#include "spdlog/sinks/stdout_color_sinks.h"
+
+using T = double;
+
+using filter::Join;
+using filter::LatePolicy;
+
+constexpr int64_t ms = 1000000;
+
+/**
+ * Pushes one chunk per activation with the given timestamps, then eof.
+ */
+class Feed: public Filter
+{
+public:
+    Feed(common::Logger logger, std::string_view name, std::vector<int64_t> timestamps):
+        Filter(logger, name), timestamps_(std::move(timestamps))
+    {
+        Pad p {.name="out", .format=Format()};
+        output_pads_.insert({p.name, p});
+    }
+
+    int activate() override
+    {
+        auto output = dynamic_cast<Link<T>*>(outputs_.at("out"));
+        if (i_ == timestamps_.size()) {
+            output->eof_reached();
+            return 0;
+        }
+        ChunkHeader header;
+        header.timestamp = timestamps_[i_++];
+        auto chunk = output->make_chunk(header);
+        chunk->fill(static_cast<T>(header.timestamp));
+        output->push(chunk);
+        return 1;
+    }
+
+    void reset() override {i_ = 0;}
+
+    Contract negotiate_format() override {return Contract::supported_format;}
+
+private:
+    std::vector<int64_t> timestamps_;
+    std::size_t          i_ = 0;
+};
+
+/**
+ * Records the timestamps of the sets (-1 for a missing input).
+ */
+class Pair: public Join<T, T>
+{
+public:
+    using Join<T, T>::Join;
+
+    std::vector<std::array<int64_t, 2>> sets;
+
+    Contract negotiate_format() override
+    {
+        return time_major_pads() ? Contract::supported_format : Contract::unsupported_format;
+    }
+
+protected:
+    void process(const Chunks& chunks) override
+    {
+        auto& [a, b] = chunks;
+        sets.push_back({a ? a->header.timestamp : -1, b ? b->header.timestamp : -1});
+    }
+};
+
+struct Bench
+{
+    Pipeline pipeline;
+    Feed   * a;
+    Feed   * b;
+    Pair   * join;
+
+    Bench(common::Logger logger, const std::vector<int64_t>& ts_a, const std::vector<int64_t>& ts_b,
+          int64_t tolerance, arma::uword max_queue, LatePolicy policy):
+        pipeline(logger)
+    {
+        auto feed_a = std::make_unique<Feed>(logger, "a", ts_a);
+        auto feed_b = std::make_unique<Feed>(logger, "b", ts_b);
+        auto pair   = std::make_unique<Pair>(logger, "join", std::array<std::string, 2>{"a", "b"},
+                                             tolerance, max_queue, policy);
+        a    = feed_a.get();
+        b    = feed_b.get();
+        join = pair.get();
+        pipeline.add_filter(std::move(feed_a));
+        pipeline.add_filter(std::move(feed_b));
+        pipeline.add_filter(std::move(pair));
+        pipeline.link<T>(a, "out", join, "a");
+        pipeline.link<T>(b, "out", join, "b");
+
+        a->set_output_format({4, 2, 1}, "out");
+        b->set_output_format({4, 2, 1}, "out");
+        if (pipeline.negotiate_format() != Contract::supported_format)
+            throw dsp_error(Errc::format_negotiation_failed);
+    }
+
+    // push everything (& eof) then join
+    void run()
+    {
+        while (a->activate()) { }
+        while (b->activate()) { }
+        join->activate();
+    }
+};
+
+int main()
+{
+    common::Logger logger(spdlog::stdout_color_mt("dsp"));
+    logger->set_level(spdlog::level::err);
+
+    // the third chunks are 300 us apart, more than the tolerance
+    const std::vector<int64_t> ts_a {0, 4 * ms, 8 * ms,           12 * ms};
+    const std::vector<int64_t> ts_b {ms / 10, 4 * ms - ms / 10, 8 * ms + 3 * ms / 10, 12 * ms};
+    const int64_t tolerance = ms / 5;
+
+    using Sets = std::vector<std::array<int64_t, 2>>;
+    const Sets matched {{ts_a[0], ts_b[0]}, {ts_a[1], ts_b[1]}, {ts_a[3], ts_b[3]}};
+
+    {
+        Bench bench(logger, ts_a, ts_b, tolerance, 16, LatePolicy::drop);
+        bench.run();
+        if (bench.join->sets != matched || bench.join->n_late() != 2) {
+            std::cerr << "drop: " << bench.join->sets.size() << " sets, "
+                      << bench.join->n_late() << " late\n";
+            return 1;
+        }
+    }
+
+    {
+        Bench bench(logger, ts_a, ts_b, tolerance, 16, LatePolicy::partial);
+        bench.run();
+        const Sets expected {{ts_a[0], ts_b[0]}, {ts_a[1], ts_b[1]}, {ts_a[2], -1},
+                             {-1, ts_b[2]}, {ts_a[3], ts_b[3]}};
+        if (bench.join->sets != expected || bench.join->n_late() != 2) {
+            std::cerr << "partial: " << bench.join->sets.size() << " sets, "
+                      << bench.join->n_late() << " late\n";
+            return 1;
+        }
+    }
+
+    {
+        Bench bench(logger, ts_a, ts_b, tolerance, 16, LatePolicy::fail);
+        try {
+            bench.run();
+            std::cerr << "fail: misaligned chunks accepted\n";
+            return 1;
+        } catch (dsp_error&) {
+            if (bench.join->sets.size() != 2) {
+                std::cerr << "fail: " << bench.join->sets.size() << " sets before the error\n";
+                return 1;
+            }
+        }
+    }
+
+    // skewed branch: b lags 3 chunks behind a, within the queue size
+    std::vector<int64_t> ts;
+    for (int64_t i = 0; i < 40; ++i)
+        ts.push_back(i * 4 * ms);
+    {
+        const arma::uword max_queue = 4;
+        Bench bench(logger, ts, ts, 0, max_queue, LatePolicy::drop);
+        for (int i = 0; i < 3; ++i)
+            bench.a->activate();
+        while (bench.a->activate()) {
+            bench.b->activate();
+            bench.join->activate();
+        }
+        while (bench.b->activate())
+            bench.join->activate();
+        bench.join->activate();
+        if (bench.join->sets.size() != ts.size() || bench.join->n_late() != 0) {
+            std::cerr << "skewed: " << bench.join->sets.size() << " sets, "
+                      << bench.join->n_late() << " late\n";
+            return 1;
+        }
+    }
+
+    // stalled branch: b never pushes, the chunks of a are late once the queue is
+    // full instead of piling up in its link
+    {
+        const arma::uword max_queue = 4;
+        Bench bench(logger, ts, {}, 0, max_queue, LatePolicy::drop);
+        std::size_t peak_queued = 0;
+        while (bench.a->activate()) {
+            bench.join->activate();
+            peak_queued = std::max(peak_queued, bench.join->memory_usage());
+        }
+        auto counters = bench.pipeline.link_counters();
+        const auto& link = counters.at("a.out -> join.a");
+        if (bench.join->n_late() != ts.size() - max_queue + 1 || !bench.join->sets.empty() ||
+            link.n_chunks != ts.size() || peak_queued > max_queue * 4 * 2 * sizeof(T)) {
+            std::cerr << "stalled: " << bench.join->n_late() << " late, "
+                      << peak_queued << " B queued\n";
+            return 1;
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,176 @@
+#include <iostream>
+
+#include "test_utils.h"
+
+#include "dsp/tee_filter.h"
+
+#include "spdlog/common.h"
+#include "spdlog/sinks/stdout_color_sinks.h"
+
+using T = double;
+
+constexpr int64_t     ms          = 1000000;
+constexpr std::size_t chunk_bytes = 4 * 2 * 1 * sizeof(T);
+
+/**
+ * Keeps the chunks in its link until opened, then records their headers.
+ */
+class Gate: public Filter
+{
+public:
+    Gate(common::Logger logger, std::string_view name): Filter(logger, name)
+    {
+        Pad p {.name="in", .format=Format()};
+        input_pads_.insert({p.name, p});
+    }
+
+    int activate() override
+    {
+        if (!open)
+            return 0;
+        auto input = dynamic_cast<Link<T>*>(inputs_.at("in"));
+        typename Link<T>::const_elem_type chunk;
+        int ret = 0;
+        while (input->pop(chunk)) {
+            headers.push_back(chunk->header);
+            ret = 1;
+        }
+        return ret;
+    }
+
+    void reset() override {headers.clear();}
+
+    Contract negotiate_format() override {return Contract::supported_format;}
+
+    bool                     open = false;
+    std::vector<ChunkHeader> headers;
+};
+
+// source -> tee -> gate0
+//               -> gate1
+struct Bench
+{
+    Pipeline                     pipeline;
+    filter::Source<int16_t, T> * source;
+    std::array<Gate*, 2>         gates;
+    uint32_t                     ts = 0;
+
+    Bench(common::Logger logger): pipeline(logger)
+    {
+        auto source_filter = std::make_unique<filter::Source<int16_t, T>>(logger);
+        source = source_filter.get();
+        pipeline.add_filter(std::move(source_filter));
+        auto tee = pipeline.add_filter(std::make_unique<filter::Tee<T, 2>>(logger));
+        pipeline.link<T>(source, "out", tee, "in");
+        for (arma::uword i = 0; i < gates.size(); ++i) {
+            auto gate = std::make_unique<Gate>(logger, "gate" + std::to_string(i));
+            gates[i] = gate.get();
+            pipeline.add_filter(std::move(gate));
+            pipeline.link<T>(tee, std::to_string(i), gates[i], "in");
+        }
+
+        // 4 frames of 2 channels per chunk
+        source->set_output_format({4, 2, 1}, "out");
+        if (pipeline.negotiate_format() != Contract::supported_format)
+            throw dsp_error(Errc::format_negotiation_failed);
+    }
+
+    // push the frames of n chunks
+    void push(arma::uword n)
+    {
+        const int16_t x[2] = {1, -1};
+        for (arma::uword i = 0; i < 4 * n; ++i, ++ts)
+            source->push_frame(std::string_view(reinterpret_cast<const char*>(x), sizeof(x)), ts);
+    }
+
+    uint64_t n_dropped(arma::uword i)
+    {
+        return pipeline.link_counters().at("tee." + std::to_string(i) + " -> gate"
+                                           + std::to_string(i) + ".in").n_dropped;
+    }
+};
+
+int main()
+{
+    common::Logger logger(spdlog::stdout_color_mt("dsp"));
+    logger->set_level(spdlog::level::err);
+
+    // the chunks pushed by the tee are in both links but only counted once
+    {
+        Bench bench(logger);
+        for (int i = 0; i < 2; ++i) {
+            bench.push(1);
+            bench.pipeline.run();
+        }
+        if (bench.pipeline.memory_usage() != 2 * chunk_bytes ||
+            bench.pipeline.peak_memory_usage() != 2 * chunk_bytes) {
+            std::cerr << "usage: " << bench.pipeline.memory_usage() << " B (peak "
+                      << bench.pipeline.peak_memory_usage() << " B) for 2 chunks\n";
+            return 1;
+        }
+
+        // degrade: the oldest chunks are dropped from both links once a third one
+        // is queued
+        const std::size_t budget = 2 * chunk_bytes;
+        bench.pipeline.set_memory_budget(budget, Pipeline::MemoryPolicy::degrade);
+        for (int i = 0; i < 2; ++i) {
+            bench.push(1);
+            bench.pipeline.run();
+        }
+        if (bench.pipeline.memory_usage() > budget ||
+            bench.pipeline.peak_memory_usage() != budget + chunk_bytes) {
+            std::cerr << "degrade: " << bench.pipeline.memory_usage() << " B (peak "
+                      << bench.pipeline.peak_memory_usage() << " B) for a budget of "
+                      << budget << " B\n";
+            return 1;
+        }
+        for (arma::uword i = 0; i < bench.gates.size(); ++i) {
+            if (bench.n_dropped(i) != 2) {
+                std::cerr << "degrade: " << bench.n_dropped(i) << " chunks dropped on gate"
+                          << i << "\n";
+                return 1;
+            }
+            auto gate = bench.gates[i];
+            gate->open = true;
+            gate->activate();
+            if (gate->headers.size() != 2 || gate->headers[0].timestamp != 8 * ms ||
+                !gate->headers[0].has(chunk_flag::discontinuity) ||
+                gate->headers[1].has(chunk_flag::discontinuity)) {
+                std::cerr << "degrade: gate" << i << " got " << gate->headers.size()
+                          << " chunks\n";
+                return 1;
+            }
+        }
+        if (bench.pipeline.memory_usage() != 0) {
+            std::cerr << "degrade: " << bench.pipeline.memory_usage() << " B left\n";
+            return 1;
+        }
+    }
+
+    // frames coming while the source isn't activated: its queue is bounded
+    {
+        Bench bench(logger);
+        bench.source->set_max_queue(2);
+        bench.push(4);
+        if (bench.source->n_dropped_chunks() != 2 ||
+            bench.source->memory_usage() != 2 * chunk_bytes) {
+            std::cerr << "source: " << bench.source->n_dropped_chunks() << " chunks dropped, "
+                      << bench.source->memory_usage() << " B queued\n";
+            return 1;
+        }
+        for (auto gate: bench.gates)
+            gate->open = true;
+        bench.pipeline.run();
+        for (auto gate: bench.gates) {
+            if (gate->headers.size() != 2 || gate->headers[0].timestamp != 8 * ms ||
+                !gate->headers[0].has(chunk_flag::discontinuity) ||
+                gate->headers[1].has(chunk_flag::discontinuity)) {
+                std::cerr << "source: " << gate->name() << " got " << gate->headers.size()
+                          << " chunks\n";
+                return 1;
+            }
+        }
+    }
+
+    return 0;
+}
@@ -22,11 +22,13 @@ int main(int argc, char * argv[])
 
     Pipeline pipeline(logger);
 
-    auto source_filter_iq = std::make_unique<NpySource<T1>>(logger, filename_iq, 1, "iq source");
+    auto source_filter_iq = std::make_unique<NpySource<T1>>(logger, filename_iq, Period::ms(1), "iq source");
     auto fmt_data = source_filter_iq->get_fmt();
     auto source_iq = pipeline.add_filter(std::move(source_filter_iq));
 
-    auto source_filter_cor = std::make_unique<NpySource<T2>>(logger, filename_cor, 1, "cor source");
+    // one correlation coefficient per iq chunk, the timestamps must match
+    arma::uword n_iq = 30;
+    auto source_filter_cor = std::make_unique<NpySource<T2>>(logger, filename_cor, Period::ms(n_iq), "cor source");
     auto source_cor = pipeline.add_filter(std::move(source_filter_cor));
 
     auto extractor = std::make_unique<filter::QIFeatureFilter<T1, T2>>(logger);
@@ -40,7 +42,6 @@ int main(int argc, char * argv[])
     pipeline.link<T2>(source_cor, "out", extractor_h, "cor");
     pipeline.link<T2>(extractor_h, "out", sink_h, "in");
 
-    arma::uword n_iq = 30;
     arma::uword n_feat = 2;
     Format fmt_iq  { n_iq  , fmt_data.n_cols, fmt_data.n_slices };
     Format fmt_cor { 1     , fmt_data.n_cols, fmt_data.n_slices };
@@ -0,0 +1,155 @@
+#include <filesystem>
+#include <iostream>
+
+#include "test_utils.h"
+
+#include "dsp/iir_filter.h"
+#include "dsp/fd_filter.h"
+
+#include "spdlog/common.h"
+#include "spdlog/sinks/stdout_color_sinks.h"
+
+using T = arma::cx_double;
+
+constexpr arma::uword nfft = 16;
+
+// source -> iir -> fd -> sink
+struct Chain
+{
+    std::unique_ptr<Pipeline>   pipeline;
+    filter::IIR<T, double>    * iir;
+    filter::FD<T, double>     * fd;
+    NpySink<double>           * sink;
+
+    Chain(common::Logger logger, const std::string& filename_in,
+          const arma::vec& b, const arma::vec& a):
+        pipeline(std::make_unique<Pipeline>(logger))
+    {
+        auto source_filter = std::make_unique<NpySource<T>>(logger, filename_in, Period::ms(1));
+        auto fmt_data = source_filter->get_fmt();
+        auto source_h = pipeline->add_filter(std::move(source_filter));
+
+        auto iir_filter = std::make_unique<filter::IIR<T, double>>(logger, "iir", b, a);
+        iir = iir_filter.get();
+        auto iir_h = pipeline->add_filter(std::move(iir_filter));
+
+        auto fd_filter = std::make_unique<filter::FD<T, double>>(
+                logger, nfft, arma::vec(nfft, arma::fill::ones));
+        fd = fd_filter.get();
+        auto fd_h = pipeline->add_filter(std::move(fd_filter));
+
+        auto sink_filter = std::make_unique<NpySink<double>>(
+                logger, arma::SizeCube(fmt_data.n_rows / nfft, fmt_data.n_cols, fmt_data.n_slices));
+        sink = sink_filter.get();
+        auto sink_h = pipeline->add_filter(std::move(sink_filter));
+
+        pipeline->link<T>(source_h, "out", iir_h, "in");
+        pipeline->link<T>(iir_h, "out", fd_h, "in");
+        pipeline->link<double>(fd_h, "out", sink_h, "in");
+
+        source_h->set_output_format({nfft, fmt_data.n_cols, fmt_data.n_slices}, "out");
+        if (pipeline->negotiate_format() != Contract::supported_format)
+            throw dsp_error(Errc::format_negotiation_failed);
+    }
+
+    // run until the sink got n chunks
+    void process(arma::uword n)
+    {
+        while (sink->n_chunks() < n) {
+            sink->activate();
+            pipeline->run();
+        }
+    }
+
+    arma::cube dump(const std::string& filename)
+    {
+        sink->dump(filename);
+        return load_npy<double>(filename);
+    }
+};
+
+int main()
+{
+    common::Logger logger(spdlog::stdout_color_mt("dsp"));
+    logger->set_level(spdlog::level::warn);
+
+    const auto dir = std::filesystem::temp_directory_path() / "dsp_reconfigure_test";
+    std::filesystem::create_directories(dir);
+    const std::string filename_in   = dir / "in.npy";
+    const std::string filename_tail = dir / "tail.npy";
+    const std::string filename_out  = dir / "out.npy";
+
+    // retuned mid-stream, after k chunks
+    const arma::uword n_chunks = 20, k = 8;
+    arma::arma_rng::set_seed(0);
+    arma::Cube<T> data(n_chunks * nfft, 3, 2, arma::fill::randn);
+    save_npy<T>(filename_in, data);
+    save_npy<T>(filename_tail, arma::Cube<T>(data.rows(k * nfft, data.n_rows - 1)));
+
+    const arma::vec b1 {0.2, 0.2}, a1 {1, -0.6};
+    const arma::vec b2 {0.5, 0.3, 0.2}, a2 {1, -0.2};
+
+    // references: whole stream with the first coefficients, the rest of the stream
+    // from a clean state with the second ones
+    const arma::cube ref1 = Chain(logger, filename_in, b1, a1).dump(filename_out);
+    const arma::cube ref2 = Chain(logger, filename_tail, b2, a2).dump(filename_out);
+
+    // rejected configuration: nothing changes
+    {
+        Chain c(logger, filename_in, b1, a1);
+        c.process(k);
+        c.pipeline->pause();
+        const auto n_plans = fftw::n_plans();
+        auto ret = c.pipeline->reconfigure({c.fd},
+                [&]() {c.fd->set_nfft(2 * nfft, arma::vec(2 * nfft, arma::fill::ones));},
+                [&]() {c.fd->set_nfft(nfft, arma::vec(nfft, arma::fill::ones));});
+        if (ret != Contract::unsupported_format || c.pipeline->negotiation_error().empty()) {
+            std::cerr << "invalid nfft accepted\n";
+            return 1;
+        }
+        if (fftw::n_plans() != n_plans || c.sink->n_chunks() != k) {
+            std::cerr << "pipeline modified by a rejected reconfiguration\n";
+            return 1;
+        }
+        c.pipeline->resume();
+        if (!arma::approx_equal(c.dump(filename_out), ref1, "absdiff", 1e-12)) {
+            std::cerr << "output modified by a rejected reconfiguration\n";
+            return 1;
+        }
+    }
+
+    // new coefficients
+    {
+        Chain c(logger, filename_in, b1, a1);
+        c.process(k);
+        c.pipeline->pause();
+
+        // nothing runs while paused
+        c.sink->activate();
+        c.pipeline->run();
+        if (c.sink->n_chunks() != k) {
+            std::cerr << "pipeline ran while paused\n";
+            return 1;
+        }
+
+        const auto n_plans = fftw::n_plans();
+        auto ret = c.pipeline->reconfigure({c.iir}, [&]() {c.iir->set_coefficients(b2, a2);});
+        if (ret != Contract::supported_format) {
+            std::cerr << "reconfiguration failed: " << c.pipeline->negotiation_error() << "\n";
+            return 1;
+        }
+        // same nfft: the plan of the fd filter is kept
+        if (fftw::n_plans() != n_plans) {
+            std::cerr << "fft plan created again\n";
+            return 1;
+        }
+        c.pipeline->resume();
+        if (!arma::approx_equal(c.dump(filename_out), ref2, "absdiff", 1e-12)) {
+            std::cerr << "output doesn't match the new coefficients\n";
+            return 1;
+        }
+    }
+
+    std::filesystem::remove_all(dir);
+    return 0;
+}
@@ -0,0 +1,70 @@
+#include "test_utils.h"
+
+#include "dsp/resample_filter.h"
+
+#include "spdlog/common.h"
+#include "spdlog/sinks/stdout_color_sinks.h"
+
+using T = arma::cx_double;
+
+int main(int argc, char * argv[])
+{
+    if (argc != 4)
+        return -1;
+
+    std::string filename_in(argv[1]);
+    std::string filename_out(argv[2]);
+    std::string filename_params(argv[3]);
+
+    cnpy::NpyArray nskip_np  = cnpy::npz_load(filename_params, "nskip");
+    cnpy::NpyArray up_np     = cnpy::npz_load(filename_params, "up");
+    cnpy::NpyArray down_np   = cnpy::npz_load(filename_params, "down");
+
+    arma::uword nskip(*nskip_np.data<arma::uword>());
+    arma::uword up(*up_np.data<arma::uword>());
+    arma::uword down(*down_np.data<arma::uword>());
+
+    common::Logger logger(spdlog::stdout_color_mt("dsp"));
+    logger->set_level(spdlog::level::info);
+
+    Pipeline pipeline(logger);
+
+    auto source_filter = std::make_unique<NpySource<T>>(logger, filename_in, Period::ms(1));
+    auto fmt_data = source_filter->get_fmt();
+    auto source_h = pipeline.add_filter(std::move(source_filter));
+
+    auto resample_filter = std::make_unique<filter::Resample<T>>(logger, up, down);
+    auto resample_h = pipeline.add_filter(std::move(resample_filter));
+
+    auto sink_filter = std::make_unique<NpySink<T>>(logger, fmt_data);
+    auto sink_p = sink_filter.get();
+    auto sink_h = pipeline.add_filter(std::move(sink_filter));
+
+    pipeline.link<T>(source_h, "out", resample_h, "in");
+    pipeline.link<T>(resample_h, "out", sink_h, "in");
+
+    Format fmt_in  { nskip * down, fmt_data.n_cols, fmt_data.n_slices };
+    Format fmt_out { nskip * up, fmt_in.n_cols, fmt_in.n_slices };
+    source_h->set_output_format(fmt_in, "out");
+    resample_h->set_input_format(fmt_in, "in");
+    resample_h->set_output_format(fmt_out, "out");
+    sink_h->set_input_format(fmt_out, "in");
+    if (pipeline.negotiate_format() != Contract::supported_format)
+        throw dsp_error(Errc::format_negotiation_failed);
+
+    std::cout << "Input:\n"
+              << "  type: " << typeid(T).name() << "\n"
+              << "  chunk size: (" << fmt_in.n_rows << "," << fmt_in.n_cols << "," << fmt_in.n_slices << ")\n"
+              << "  nb frames total: " << fmt_data.n_rows << "\n"
+              << "------------------------------\n"
+              << "Filter params:\n"
+              << "  up:   " << up << "\n"
+              << "  down: " << down << "\n"
+              << "------------------------------\n";
+
+    sink_p->dump(filename_out);
+
+    pipeline.print_stats();
+
+    return 0;
+}
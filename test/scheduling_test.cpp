@@ -0,0 +1,101 @@
+#include <filesystem>
+#include <iostream>
+
+#include "test_utils.h"
+
+#include "dsp/iir_filter.h"
+
+#include "spdlog/common.h"
+#include "spdlog/sinks/stdout_color_sinks.h"
+
+using T = arma::cx_double;
+
+constexpr arma::uword n_stages = 3;
+
+struct Run
+{
+    arma::Cube<T> out;
+    arma::uword   n_activations = 0;
+    arma::uword   n_idle        = 0;
+    arma::uword   n_forwarded   = 0;
+};
+
+// source -> iir0 -> iir1 -> iir2 -> sink
+static Run run(common::Logger logger, const std::string& filename_in,
+               const std::string& filename_out, Pipeline::Scheduling scheduling)
+{
+    Pipeline pipeline(logger);
+    pipeline.set_scheduling(scheduling);
+
+    auto source_filter = std::make_unique<NpySource<T>>(logger, filename_in, Period::ms(1));
+    auto fmt_data = source_filter->get_fmt();
+    auto source_h = pipeline.add_filter(std::move(source_filter));
+
+    std::vector<Filter*> filters {source_h};
+    const arma::vec b {0.2, 0.2}, a {1, -0.6};
+    for (arma::uword i = 0; i < n_stages; ++i) {
+        auto iir_h = pipeline.add_filter(std::make_unique<filter::IIR<T, double>>(
+                logger, "iir" + std::to_string(i), b, a));
+        pipeline.link<T>(filters.back(), "out", iir_h, "in");
+        filters.push_back(iir_h);
+    }
+
+    auto sink_filter = std::make_unique<NpySink<T>>(logger, fmt_data);
+    auto sink_p = sink_filter.get();
+    auto sink_h = pipeline.add_filter(std::move(sink_filter));
+    pipeline.link<T>(filters.back(), "out", sink_h, "in");
+
+    // the other formats are derived from the source
+    source_h->set_output_format({10, fmt_data.n_cols, fmt_data.n_slices}, "out");
+    if (pipeline.negotiate_format() != Contract::supported_format)
+        throw dsp_error(Errc::format_negotiation_failed);
+
+    sink_p->dump(filename_out);
+
+    Run r;
+    r.out = load_npy<T>(filename_out);
+    for (auto f: filters) {
+        r.n_activations += f->n_activations();
+        r.n_idle        += f->n_idle_activations();
+    }
+    r.n_forwarded = pipeline.n_forwarded();
+    return r;
+}
+
+int main()
+{
+    common::Logger logger(spdlog::stdout_color_mt("dsp"));
+    logger->set_level(spdlog::level::warn);
+
+    const auto dir = std::filesystem::temp_directory_path() / "dsp_scheduling_test";
+    std::filesystem::create_directories(dir);
+    const std::string filename_in = dir / "in.npy";
+
+    arma::arma_rng::set_seed(0);
+    save_npy<T>(filename_in, arma::Cube<T>(200, 4, 2, arma::fill::randn));
+
+    auto eager  = run(logger, filename_in, dir / "eager.npy", Pipeline::Scheduling::eager);
+    auto demand = run(logger, filename_in, dir / "demand.npy", Pipeline::Scheduling::demand);
+    std::filesystem::remove_all(dir);
+
+    std::cout << "eager:  " << eager.n_activations << " activations (" << eager.n_idle
+              << " idle), " << eager.n_forwarded << " forwarded\n"
+              << "demand: " << demand.n_activations << " activations (" << demand.n_idle
+              << " idle), " << demand.n_forwarded << " forwarded\n";
+
+    if (!arma::approx_equal(eager.out, demand.out, "absdiff", 0)) {
+        std::cerr << "outputs differ between the schedulings\n";
+        return 1;
+    }
+    if (eager.n_forwarded != 0) {
+        std::cerr << "requests forwarded in eager mode\n";
+        return 1;
+    }
+    // each starved stage of the chain forwards the request instead of being
+    // activated for nothing
+    if (demand.n_forwarded < n_stages || demand.n_idle >= eager.n_idle) {
+        std::cerr << "demand scheduling didn't save idle activations\n";
+        return 1;
+    }
+    return 0;
+}
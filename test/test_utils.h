@@ -5,127 +5,25 @@
 #include "dsp/pipeline.h"
 #include "dsp/source_filter.h"
 #include "dsp/sink_filter.h"
+#include "dsp/npy_filter.h"
 
 using namespace dsp;
 
+using filter::NpySource;
+using filter::NpySink;
+
+/**
+ * @brief Save a cube with the layout read by NpySource (& written by NpySink).
+ */
 template<typename T>
-class NpySource: public Filter
+inline void save_npy(const std::string& filename, const arma::Cube<T>& data)
 {
-public:
-    NpySource(common::Logger logger, std::string filename, arma::uword sample_period = 1,
-              std::string name = "npy_source"):
-        Filter(logger, name),
-        filename_(filename), sample_period_{sample_period}
-    {
-        Pad p {.name="out", .format=Format()};
-        output_pads_.insert({p.name, p});
-
-        cnpy::NpyArray np_array = cnpy::npy_load(filename_);
-        arma::uword n_rows   = np_array.shape.at(2);
-        arma::uword n_cols   = np_array.shape.at(1);
-        arma::uword n_slices = np_array.shape.at(0);
-
-        data_ = arma::Cube<T>(np_array.data<T>(), n_rows, n_cols, n_slices);
-    }
-
-    int activate() override
-    {
-        log_debug(logger_, "{} filter activated, i = {}", this->name_, i_);
-        auto output = dynamic_cast<Link<T>*>(outputs_.at("out"));
-        auto fmt    = output->format();
-
-        arma::uword row_beg = i_ * fmt.n_rows;
-        arma::uword row_end = (i_+1) * fmt.n_rows;
-        if (row_end <= data_.n_rows) {
-            auto chunk = std::make_shared<Chunk<T>>(row_beg, sample_period_,
-                                                    data_.rows(row_beg, row_end - 1));
-            output->push(chunk);
-            i_++;
-            return 1;
-        } else {
-            log_debug(logger_, "eof");
-            output->eof_reached();
-            return 0;
-        }
-    }
-
-    void reset() override
-    {
-        i_ = 0;
-    }
-
-    Contract negotiate_format() override
-    {
-        return Contract::supported_format;
-    }
-
-    arma::SizeCube get_fmt()
-    {
-        return arma::size(data_);
-    }
-
-private:
-    std::string    filename_;
-    arma::Cube<T>  data_;
-    arma::uword    i_ = 0;
-    arma::uword    sample_period_;
-};
-
+    cnpy::npy_save(filename, data.memptr(), {data.n_slices, data.n_cols, data.n_rows}, "w");
+}
 
 template<typename T>
-class NpySink: public Filter
+inline arma::Cube<T> load_npy(const std::string& filename)
 {
-public:
-    NpySink(common::Logger logger, arma::SizeCube fmt, std::string_view name = "sink"):
-        Filter(logger, name), data_(arma::Cube<T>(fmt))
-    {
-        Pad p {.name="in", .format=Format()};
-        input_pads_.insert({p.name, p});
-    }
-
-    int activate() override
-    {
-        log_debug(logger_, "{} filter activated, i = {}", name_, i_);
-
-        auto input = dynamic_cast<Link<T>*>(inputs_.at("in"));
-        auto chunk = std::make_shared<Chunk<T>>();
-
-        if (!input->pop(chunk))
-            return 0;
-
-
-        if (verbose_)
-            chunk->print();
-
-        data_.rows(i_ * chunk->n_rows, (i_+1) * chunk->n_rows - 1) = *chunk;
-        i_++;
-
-        return 1;
-    }
-
-    void reset() override
-    {
-        i_ = 0;
-    }
-
-    Contract negotiate_format() override
-    {
-        return Contract::supported_format;
-    }
-
-    void dump(std::string filename)
-    {
-        auto input = dynamic_cast<Link<T>*>(inputs_.at("in"));
-        while (!input->eof()) {
-            activate();
-            this->pipeline_->run();
-        }
-        auto fmt   = input->format();
-        data_.resize(fmt.n_rows * i_, fmt.n_cols, fmt.n_slices);
-        cnpy::npy_save(filename, data_.memptr(), {data_.n_slices, data_.n_cols, data_.n_rows}, "w");
-    }
-
-private:
-    arma::Cube<T>  data_;
-    arma::uword    i_ = 0;
-};
+    cnpy::NpyArray a = cnpy::npy_load(filename);
+    return arma::Cube<T>(a.data<T>(), a.shape.at(2), a.shape.at(1), a.shape.at(0));
+}
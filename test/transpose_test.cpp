@@ -0,0 +1,18 @@
+#include <iostream>
+#include "dsp/transpose.h"
+
+int main()
+{
+    // not a multiple of the block size in either dimension
+    arma::cube in(70, 45, 3, arma::fill::randu);
+    arma::cube out(45, 70, 3);
+    dsp::transpose::slices(in, out);
+
+    for (arma::uword k = 0; k < in.n_slices; ++k) {
+        if (!arma::approx_equal(out.slice(k), in.slice(k).t(), "absdiff", 0)) {
+            std::cerr << "slice " << k << " mismatch\n";
+            return 1;
+        }
+    }
+    return 0;
+}
@@ -1,40 +1,211 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <iomanip>
+#include <iostream>
+#include <thread>
+
+#include <omp.h>
+
+#include <cnpy.h>
 
 #include <mlpack/core.hpp>
 #include <mlpack/methods/random_forest/random_forest.hpp>
 #include <mlpack/methods/decision_tree/random_dimension_select.hpp>
 
+#include "dsp/forest.h"
+
 using namespace mlpack::tree;
 
+using Forest = RandomForest<GiniGain, RandomDimensionSelect>;
+using Clock  = std::chrono::steady_clock;
+
+struct Config
+{
+    size_t n_trees;
+    size_t min_leaf_size;
+};
+
+struct Result
+{
+    Config config;
+    double accuracy      = 0; /**< mean validation accuracy over the folds */
+    double train_time    = 0; /**< mean training time per fold in s */
+    double inference     = 0; /**< mean inference cost in ns per feature vector */
+    double n_nodes       = 0; /**< mean number of nodes of the compiled forest */
+};
+
+/**
+ * Load the feature matrices. Each file holds a (n_samples, n_features + 1) array,
+ * the last column being the label, i.e. a column-major (n_features + 1, n_samples)
+ * matrix. The headers are read first so that the dataset is allocated once and the
+ * files are then loaded one at a time.
+ */
+static arma::mat load_dataset(const std::vector<std::string>& filenames)
+{
+    arma::uword n_rows = 0, n_cols = 0;
+    for (auto& f: filenames) {
+        std::vector<size_t> shape;
+        size_t word_size;
+        bool   fortran_order;
+        FILE * fp = fopen(f.c_str(), "rb");
+        if (!fp)
+            throw std::runtime_error("unable to open " + f);
+        cnpy::parse_npy_header(fp, word_size, shape, fortran_order);
+        fclose(fp);
+
+        if (shape.size() != 2 || word_size != sizeof(double) || fortran_order ||
+            (n_rows != 0 && shape[1] != n_rows))
+            throw std::runtime_error("invalid feature matrix " + f);
+        n_rows  = shape[1];
+        n_cols += shape[0];
+    }
+
+    arma::mat dataset(n_rows, n_cols);
+    arma::uword col = 0;
+    for (auto& f: filenames) {
+        cnpy::NpyArray a = cnpy::npy_load(f);
+        arma::uword n = a.shape[0];
+        arma::arrayops::copy(dataset.colptr(col), a.data<double>(), n_rows * n);
+        col += n;
+    }
+    return dataset;
+}
+
+template<typename T>
+static std::vector<T> load_param(const std::string& filename, const std::string& name,
+                                 std::vector<T> def)
+{
+    cnpy::npz_t npz = cnpy::npz_load(filename);
+    auto search = npz.find(name);
+    if (search == npz.end())
+        return def;
+    // the params are saved by numpy, check the type before reinterpreting them
+    if (search->second.word_size != sizeof(T))
+        throw std::runtime_error("invalid parameter " + name + " in " + filename);
+    const T * data = search->second.data<T>();
+    return std::vector<T>(data, data + search->second.num_vals);
+}
+
+static Result cross_validate(const arma::mat& dataset, const arma::Row<size_t>& labels,
+                             const arma::uvec& perm, size_t n_classes, size_t n_folds,
+                             const Config& config)
+{
+    Result r {config};
+    const arma::uword n = dataset.n_cols;
+
+    for (size_t k = 0; k < n_folds; ++k) {
+        arma::uword beg = k * n / n_folds;
+        arma::uword end = (k + 1) * n / n_folds;
+        arma::uvec val_idx   = perm.subvec(beg, end - 1);
+        arma::uvec train_idx = arma::join_cols(perm.head(beg), perm.tail(n - end));
+
+        arma::mat         train_x = dataset.cols(train_idx);
+        arma::Row<size_t> train_y = labels.cols(train_idx);
+        arma::mat         val_x   = dataset.cols(val_idx);
+        arma::Row<size_t> val_y   = labels.cols(val_idx);
+
+        auto t0 = Clock::now();
+        Forest rf(train_x, train_y, n_classes, config.n_trees, config.min_leaf_size);
+        auto t1 = Clock::now();
+
+        auto flat = dsp::FlatForest::compile(rf);
+        arma::mat probs(n_classes, val_x.n_cols);
+        auto t2 = Clock::now();
+        flat.predict(val_x.memptr(), val_x.n_rows, val_x.n_cols, probs.memptr(), 0, n_classes);
+        auto t3 = Clock::now();
+
+        arma::Row<size_t> predictions = arma::conv_to<arma::Row<size_t>>::from(
+                arma::index_max(probs, 0));
+        r.accuracy   += double(arma::accu(predictions == val_y)) / val_y.n_elem;
+        r.train_time += std::chrono::duration<double>(t1 - t0).count();
+        r.inference  += std::chrono::duration<double, std::nano>(t3 - t2).count() / val_x.n_cols;
+        r.n_nodes    += flat.n_nodes();
+    }
+
+    r.accuracy   /= n_folds;
+    r.train_time /= n_folds;
+    r.inference  /= n_folds;
+    r.n_nodes    /= n_folds;
+    return r;
+}
+
 int main(int argc, char * argv[])
 {
-    if (argc != 3)
+    if (argc < 3) {
+        std::cerr << "usage: " << argv[0] << " <params.npz> <features.npy>...\n";
         return EXIT_FAILURE;
+    }
 
-    // load the dataset
-    arma::mat dataset;
-    bool loaded = mlpack::data::Load(argv[1], dataset);
-    if (!loaded)
-        return EXIT_FAILURE;
+    // parameters
+    const std::string params(argv[1]);
+    const size_t n_classes = load_param<size_t>(params, "n_classes", {2}).at(0);
+    const size_t n_folds   = load_param<size_t>(params, "n_folds", {5}).at(0);
+    const auto   n_trees   = load_param<size_t>(params, "n_trees", {10});
+    const auto   min_leaf  = load_param<size_t>(params, "min_leaf_size", {5});
 
-    // extract the labels
+    // load the dataset & extract the labels
+    arma::mat dataset = load_dataset(std::vector<std::string>(argv + 2, argv + argc));
     arma::Row<size_t> labels;
     labels = arma::conv_to<arma::Row<size_t>>::from(dataset.row(dataset.n_rows - 1));
     dataset.shed_row(dataset.n_rows - 1);
+    std::cout << "dataset: " << dataset.n_cols << " samples, " << dataset.n_rows << " features\n";
 
-    // parameters
-    /* TODO: read w/ cnpy <29-03-21, cneyton> */
-    const size_t n_classes = 2;
-    const size_t n_trees   = 10;
-    const size_t min_leaf_size = 5;
+    if (n_folds < 2 || dataset.n_cols < n_folds) {
+        std::cerr << "n_folds must be in [2, " << dataset.n_cols << "]\n";
+        return EXIT_FAILURE;
+    }
+
+    arma::arma_rng::set_seed(0);
+    const arma::uvec perm = arma::randperm(dataset.n_cols);
+
+    // hyperparameter sweep: one single threaded cross-validation per configuration,
+    // at most one per core at a time
+    std::vector<Config> configs;
+    for (auto t: n_trees)
+        for (auto l: min_leaf)
+            configs.push_back({t, l});
+
+    const size_t n_workers = std::max(1u, std::thread::hardware_concurrency());
+    std::vector<Result> results(configs.size());
+    std::atomic<size_t> next {0};
+    std::vector<std::future<void>> workers;
+    for (size_t w = 0; w < std::min(n_workers, configs.size()); ++w) {
+        workers.push_back(std::async(std::launch::async, [&]() {
+            omp_set_num_threads(1);
+            for (size_t i = next++; i < configs.size(); i = next++)
+                results[i] = cross_validate(dataset, labels, perm, n_classes, n_folds, configs[i]);
+        }));
+    }
+    for (auto& w: workers)
+        w.get();
+
+    std::cout << std::setw(8) << "n_trees" << std::setw(10) << "min_leaf"
+              << std::setw(10) << "accuracy" << std::setw(12) << "train (s)"
+              << std::setw(14) << "infer (ns)" << std::setw(10) << "nodes" << "\n";
+    for (auto& r: results) {
+        std::cout << std::setw(8)  << r.config.n_trees << std::setw(10) << r.config.min_leaf_size
+                  << std::setw(10) << std::setprecision(4) << r.accuracy
+                  << std::setw(12) << r.train_time << std::setw(14) << r.inference
+                  << std::setw(10) << r.n_nodes << "\n";
+    }
+
+    // train the best configuration on the whole dataset, trees trained in parallel
+    auto best = std::max_element(results.cbegin(), results.cend(),
+                                 [](auto& a, auto& b) {return a.accuracy < b.accuracy;});
+    std::cout << "best: n_trees = " << best->config.n_trees
+              << ", min_leaf_size = " << best->config.min_leaf_size << "\n";
 
-    auto rf = RandomForest<GiniGain, RandomDimensionSelect>(dataset, labels,
-                                                            n_classes, n_trees, min_leaf_size);
+    omp_set_num_threads(omp_get_num_procs());
+    auto rf = Forest(dataset, labels, n_classes, best->config.n_trees, best->config.min_leaf_size);
 
     arma::Row<size_t> predictions;
     rf.Classify(dataset, predictions);
     const size_t correct = arma::accu(predictions == labels);
-    std::cout << "\nTraining Accuracy: " << (double(correct) / double(labels.n_elem));
+    std::cout << "Training Accuracy: " << (double(correct) / double(labels.n_elem)) << "\n";
 
     // save  the model
     mlpack::data::Save("qi_model.xml", "qi_model", rf, true);
+    dsp::FlatForest::compile(rf).save("qi_model.bin");
 }
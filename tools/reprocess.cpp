@@ -0,0 +1,241 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <future>
+#include <iomanip>
+#include <iostream>
+#include <thread>
+
+#include <cnpy.h>
+
+#include "spdlog/sinks/stdout_color_sinks.h"
+
+#include "dsp/pipeline.h"
+#include "dsp/npy_filter.h"
+#include "dsp/fftw.h"
+#include "dsp/iir_filter.h"
+#include "dsp/roll_filter.h"
+#include "dsp/buffer_filter.h"
+#include "dsp/fd_filter.h"
+#include "dsp/fhr_filter.h"
+
+namespace fs = std::filesystem;
+using namespace dsp;
+
+using T_iq = arma::cx_double;
+using T_fd = double;
+using Clock = std::chrono::steady_clock;
+
+/**
+ * Parameters of the fhr pipeline, same keys as full_pipeline_test. batch_size is
+ * optional (see Pipeline::set_batch_size).
+ */
+struct Params
+{
+    arma::vec   b1, a1, b2, a2;
+    arma::uword nskip, nfft, fdskip, fdperseg, radius, period_max;
+    T_fd        threshold;
+    arma::uword batch_size = 64;
+
+    Params(const std::string& filename)
+    {
+        cnpy::npz_t npz = cnpy::npz_load(filename);
+        auto vec = [&npz](const std::string& key) {
+            auto& a = npz.at(key);
+            return arma::vec(a.data<double>(), a.shape.at(0));
+        };
+        auto uword = [&npz](const std::string& key) {return *npz.at(key).data<arma::uword>();};
+
+        b1         = vec("b1");
+        a1         = vec("a1");
+        b2         = vec("b2");
+        a2         = vec("a2");
+        nskip      = uword("nskip");
+        nfft       = uword("nfft");
+        fdskip     = uword("fdskip");
+        fdperseg   = uword("fdperseg");
+        radius     = uword("radius");
+        period_max = uword("period_max");
+        threshold  = *npz.at("threshold").data<T_fd>();
+        if (npz.find("batch_size") != npz.end())
+            batch_size = uword("batch_size");
+    }
+};
+
+struct Result
+{
+    fs::path    filename;
+    arma::uword n_samples = 0;
+    double      duration  = 0; /**< processing time in s (pipeline setup included) */
+    std::string error;
+};
+
+static std::vector<fs::path> list_recordings(const fs::path& path)
+{
+    std::vector<fs::path> files;
+    if (fs::is_directory(path)) {
+        for (auto& e: fs::directory_iterator(path))
+            if (e.is_regular_file() && e.path().extension() == ".npy")
+                files.push_back(e.path());
+        std::sort(files.begin(), files.end());
+    } else {
+        // manifest: one recording per line
+        std::ifstream is(path);
+        std::string line;
+        while (std::getline(is, line))
+            if (!line.empty() && line[0] != '#')
+                files.push_back(line);
+    }
+    return files;
+}
+
+static Result process(common::Logger logger, const Params& p, const fs::path& filename,
+                      const fs::path& output_dir)
+{
+    Result r {filename};
+    auto t0 = Clock::now();
+
+    Pipeline pipeline(logger);
+    pipeline.set_batch_size(p.batch_size);
+
+    auto source_filter = std::make_unique<filter::NpySource<T_iq>>(logger, filename, Period::ms(1));
+    auto fmt_data = source_filter->get_fmt();
+    auto source_h = pipeline.add_filter(std::move(source_filter));
+    auto iir_iq_h = pipeline.add_filter(
+            std::make_unique<filter::IIR<T_iq, double>>(logger, "iir_iq", p.b1, p.a1));
+    auto roll_iq_h = pipeline.add_filter(
+            std::make_unique<filter::Roll<T_iq>>(logger, "roll_iq", 1));
+    auto fd_h = pipeline.add_filter(
+            std::make_unique<filter::FD<T_iq, T_fd>>(logger, p.nfft, arma::vec(p.nfft, arma::fill::ones)));
+    auto buffer_h = pipeline.add_filter(std::make_unique<filter::Buffer<T_fd>>(logger));
+    auto iir_fd_h = pipeline.add_filter(
+            std::make_unique<filter::IIR<T_fd, double>>(logger, "iir_fd", p.b2, p.a2));
+    auto roll_fd_h = pipeline.add_filter(
+            std::make_unique<filter::Roll<T_fd>>(logger, "roll_fd", 1));
+    auto fhr_h = pipeline.add_filter(
+            std::make_unique<filter::FHR<T_fd, T_fd, T_fd>>(logger, p.radius, p.period_max, p.threshold));
+
+    auto sink_filter_0 = std::make_unique<filter::NpySink<T_fd>>(logger, fmt_data, "sink_fhr");
+    auto sink_p0 = sink_filter_0.get();
+    auto sink0_h = pipeline.add_filter(std::move(sink_filter_0));
+    auto sink_filter_1 = std::make_unique<filter::NpySink<T_fd>>(logger, fmt_data, "sink_cor");
+    auto sink_p1 = sink_filter_1.get();
+    auto sink1_h = pipeline.add_filter(std::move(sink_filter_1));
+
+    pipeline.link<T_iq>(source_h , "out", iir_iq_h , "in");
+    pipeline.link<T_iq>(iir_iq_h , "out", roll_iq_h, "in");
+    pipeline.link<T_iq>(roll_iq_h, "out", fd_h     , "in");
+    pipeline.link<T_fd>(fd_h     , "out", buffer_h , "in");
+    pipeline.link<T_fd>(buffer_h , "out", iir_fd_h , "in");
+    pipeline.link<T_fd>(iir_fd_h , "out", roll_fd_h, "in");
+    pipeline.link<T_fd>(roll_fd_h, "out", fhr_h    , "in");
+    pipeline.link<T_fd>(fhr_h    , "fhr", sink0_h  , "in");
+    pipeline.link<T_fd>(fhr_h    , "cor", sink1_h  , "in");
+
+    Format fmt_in      { p.nskip   , fmt_data.n_cols, fmt_data.n_slices };
+    Format fmt_roll_iq { p.nfft    , fmt_in.n_cols, fmt_in.n_slices };
+    Format fmt_fd      { 1         , fmt_in.n_cols, fmt_in.n_slices };
+    Format fmt_buffer  { p.fdskip  , fmt_in.n_cols, fmt_in.n_slices };
+    Format fmt_roll_fd { p.fdperseg, fmt_in.n_cols, fmt_in.n_slices };
+    Format fmt_out     { 1         , fmt_in.n_cols, fmt_in.n_slices };
+
+    source_h->set_output_format(fmt_in, "out");
+    iir_iq_h->set_input_format(fmt_in, "in");
+    iir_iq_h->set_output_format(fmt_in, "out");
+    roll_iq_h->set_input_format(fmt_in, "in");
+    roll_iq_h->set_output_format(fmt_roll_iq, "out");
+    fd_h->set_input_format(fmt_roll_iq, "in");
+    fd_h->set_output_format(fmt_fd, "out");
+    buffer_h->set_input_format(fmt_fd, "in");
+    buffer_h->set_output_format(fmt_buffer, "out");
+    iir_fd_h->set_input_format(fmt_buffer, "in");
+    iir_fd_h->set_output_format(fmt_buffer, "out");
+    roll_fd_h->set_input_format(fmt_buffer, "in");
+    roll_fd_h->set_output_format(fmt_roll_fd, "out");
+    fhr_h->set_input_format(fmt_roll_fd, "in");
+    fhr_h->set_output_format(fmt_out, "fhr");
+    fhr_h->set_output_format(fmt_out, "cor");
+    sink0_h->set_input_format(fmt_out, "in");
+    sink1_h->set_input_format(fmt_out, "in");
+    if (pipeline.negotiate_format() != Contract::supported_format)
+        throw dsp_error(Errc::format_negotiation_failed);
+
+    const std::string stem = filename.stem().string();
+    sink_p0->dump(output_dir / ("fhr_"  + stem + ".npy"));
+    sink_p1->dump(output_dir / ("corr_" + stem + ".npy"));
+
+    r.n_samples = fmt_data.n_rows;
+    r.duration  = std::chrono::duration<double>(Clock::now() - t0).count();
+    return r;
+}
+
+int main(int argc, char * argv[])
+{
+    if (argc < 4 || argc > 6) {
+        std::cerr << "usage: " << argv[0]
+                  << " <params.npz> <recordings dir|manifest> <output dir> [n_workers] [wisdom]\n";
+        return EXIT_FAILURE;
+    }
+
+    const Params   params(argv[1]);
+    const auto     files      = list_recordings(argv[2]);
+    const fs::path output_dir = argv[3];
+    const size_t   n_workers  = argc > 4 ? std::stoul(argv[4])
+                                         : std::max(1u, std::thread::hardware_concurrency());
+    const fs::path wisdom     = argc > 5 ? fs::path(argv[5]) : fs::path();
+
+    fs::create_directories(output_dir);
+
+    common::Logger logger(spdlog::stdout_color_mt("dsp"));
+    logger->set_level(spdlog::level::warn);
+
+    // the plans measured by a previous run (or by the first pipeline of this one) are
+    // reused by all the workers
+    if (!wisdom.empty() && !fftw::import_wisdom(wisdom))
+        std::cerr << "no wisdom imported from " << wisdom << "\n";
+
+    auto t0 = Clock::now();
+    std::vector<Result> results(files.size());
+    std::atomic<size_t> next {0};
+    std::vector<std::future<void>> workers;
+    for (size_t w = 0; w < std::min(n_workers, files.size()); ++w) {
+        workers.push_back(std::async(std::launch::async, [&]() {
+            for (size_t i = next++; i < files.size(); i = next++) {
+                try {
+                    results[i] = process(logger, params, files[i], output_dir);
+                } catch (std::exception& e) {
+                    results[i].filename = files[i];
+                    results[i].error    = e.what();
+                }
+            }
+        }));
+    }
+    for (auto& w: workers)
+        w.get();
+    const double wall = std::chrono::duration<double>(Clock::now() - t0).count();
+
+    if (!wisdom.empty() && !fftw::export_wisdom(wisdom))
+        std::cerr << "unable to export wisdom to " << wisdom << "\n";
+
+    // summary
+    arma::uword n_samples = 0, n_failed = 0;
+    for (auto& r: results) {
+        if (!r.error.empty()) {
+            n_failed++;
+            std::cout << r.filename.string() << ": failed (" << r.error << ")\n";
+            continue;
+        }
+        n_samples += r.n_samples;
+        std::cout << r.filename.string() << ": " << r.n_samples << " samples, "
+                  << std::setprecision(3) << r.duration << " s\n";
+    }
+    std::cout << "------------------------------\n"
+              << "recordings: " << files.size() - n_failed << " processed, " << n_failed << " failed\n"
+              << "workers:    " << std::min(n_workers, files.size()) << "\n"
+              << "wall time:  " << wall << " s\n"
+              << "throughput: " << (wall > 0 ? n_samples / wall : 0) << " samples/s\n";
+
+    return n_failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}